@@ -19,9 +19,14 @@
 
 #include "CarlaNativePlugin.h"
 #include "DistrhoPlugin.hpp"
+#include "PluginDetails.hpp"
+#include "PluginGenericUI.hpp"
 #include "extra/Mutex.hpp"
+#include "extra/ScopedPointer.hpp"
 #include "extra/String.hpp"
 
+#include <atomic>
+
 // generates a warning if this is defined as anything else
 #define CARLA_API
 
@@ -29,29 +34,174 @@ START_NAMESPACE_DISTRHO
 
 // --------------------------------------------------------------------------------------------------------------------
 
+class IldaeilBasePlugin;
+
+// A single carla rack instance, each with its own engine and host descriptor
+struct IldaeilRack {
+    IldaeilBasePlugin* plugin = nullptr;
+    NativePluginHandle pluginHandle = nullptr;
+    NativeHostDescriptor hostDescriptor{};
+    CarlaHostHandle hostHandle = nullptr;
+    bool active = false;
+    // processed faster than realtime, as done by the latency probe
+    bool offline = false;
+};
+
+// Parameters exposed to the host, not related to the hosted plugins
+enum IldaeilParameters {
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // mix between the hosted plugins and the input, delayed to match their latency
+    kIldaeilParameterDryWet,
+   #endif
+   #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+    // fades out the hosted plugins, then stops processing them
+    kIldaeilParameterBypass,
+    // latency to report instead of the one of the hosted plugins, padded with a delay to match
+    kIldaeilParameterFixedLatency,
+   #endif
+    kIldaeilParameterCount
+};
+
+#if DISTRHO_PLUGIN_NUM_INPUTS != 0
+// Outcome of a latency probe, the latency reported by the probed plugins and the one found by feeding them impulses
+struct IldaeilLatencyProbeResult {
+    uint32_t reported = 0;
+    // -1 if nothing came out of the plugins within the probe window, or the probe was interrupted
+    int32_t measured = -1;
+};
+#endif
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+// main rack plus up to 3 extra layers
+static constexpr const uint kIldaeilMaxLayers = 4;
+
+// Key and velocity range of a layer, note-ons outside of it are not sent to the layer
+struct IldaeilLayerSplit {
+    uint8_t lowKey = 0;
+    uint8_t highKey = 127;
+    uint8_t lowVelocity = 1;
+    uint8_t highVelocity = 127;
+};
+
+// project, inactive-slot, options, layer-splits and one project per extra layer
+static constexpr const uint kIldaeilStateCount = 4 + kIldaeilMaxLayers - 1;
+
+// parameter changes reach the UI through one queue per thread processing racks, see ildaeilParameterChangeForUI
+static constexpr const uint kIldaeilParameterQueueCount = 1 + kIldaeilMaxLayers;
+#else
+// project, inactive-slot and options
+static constexpr const uint kIldaeilStateCount = 3;
+
+// non-realtime threads and the audio thread
+static constexpr const uint kIldaeilParameterQueueCount = 2;
+#endif
+
+// queue 0 is shared by the non-realtime threads, the audio thread uses 1 and each layer the one after
+static constexpr const uint kIldaeilParameterQueueAudio = 1;
+
+// longest crossfade for plugin swaps and A/B slot switches, in ms
+static constexpr const uint kIldaeilMaxCrossfadeTime = 1000;
+
+// --------------------------------------------------------------------------------------------------------------------
+
 class IldaeilBasePlugin : public Plugin
 {
 public:
     static Mutex sPluginInfoLoadMutex;
     static const char* getPluginPath(PluginType ptype);
 
+    // Save or restore the full state of a hosted plugin, as carla preset XML.
+    static bool savePluginState(CarlaHostHandle handle, uint pluginId, String& state);
+    static bool loadPluginState(CarlaHostHandle handle, uint pluginId, const char* state);
+
     const NativePluginDescriptor* fCarlaPluginDescriptor = nullptr;
-    NativePluginHandle fCarlaPluginHandle = nullptr;
 
-    NativeHostDescriptor fCarlaHostDescriptor{};
-    CarlaHostHandle fCarlaHostHandle = nullptr;
+    // rack currently shown in the UI, changed from the UI thread on plugin swap and layer selection.
+    // atomic since rack callbacks compare against it from the audio and layer threads.
+    std::atomic<NativePluginHandle> fCarlaPluginHandle { nullptr };
+    std::atomic<CarlaHostHandle> fCarlaHostHandle { nullptr };
 
     String fBinaryPath;
 
+    // time spent in run() relative to the audio block duration, peak-held with slow release
+    std::atomic<float> fProcessLoad { 0.f };
+
     void* fUI = nullptr;
 
-    IldaeilBasePlugin() : Plugin(0, 0, 1) {}
+    // generic UI model handed over by the UI when it closes, so reopening it does not query carla again.
+    // only valid for the plugin it was made for, cleared when a project is loaded while the UI is closed.
+    ScopedPointer<PluginGenericUI> fPluginGenericUICache;
+    CarlaHostHandle fPluginGenericUICacheHandle = nullptr;
+    uint fPluginGenericUICacheId = 0;
+
+    // details of the hosted plugins, only used from the UI thread and kept here while the UI is closed.
+    // cleared when a project is loaded while the UI is closed, otherwise the UI clears them when notified.
+    // the chain of the rack shown in the UI, with the details of the shown plugin stored back when the UI closes.
+    PluginChainDetails fPluginChainDetails;
+    // the A/B slot not in use
+    PluginSlot fOtherSlotDetails;
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // the chains of the layers not shown
+    PluginChainDetails fLayerChainDetails[kIldaeilMaxLayers];
+   #endif
+
+    IldaeilBasePlugin() : Plugin(kIldaeilParameterCount, 0, kIldaeilStateCount) {}
+
+    // Options set from the UI and saved with the plugin state.
+    // Crossfade time in ms for plugin swaps and A/B slot switches, always 0 without audio outputs.
+    virtual uint getCrossfadeTime() const = 0;
+    virtual void setCrossfadeTime(uint ms) = 0;
+    // Whether to keep the plugin editor instantiated (only hidden) while showing the generic UI.
+    virtual bool getKeepEmbedUI() const = 0;
+    virtual void setKeepEmbedUI(bool keep) = 0;
+
+    // Gapless plugin swap, all called from the UI thread:
+    // load the replacement into the handle returned by getSwapHostHandle() (nullptr if a swap is not possible),
+    // then call startPluginSwap() to crossfade into it, and finishPluginSwap() until it returns true.
+    virtual CarlaHostHandle getSwapHostHandle() = 0;
+    virtual void startPluginSwap() = 0;
+    virtual bool finishPluginSwap() = 0;
+
+    // A/B slots, the rack not in use can keep a 2nd setup asleep for comparison, also called from the UI thread.
+    // Switching slots goes through the same crossfade as a plugin swap, finishPluginSwap() must be called after.
+    virtual uint getCurrentSlot() const = 0;
+    virtual CarlaHostHandle getOtherSlotHostHandle() = 0;
+    virtual bool copyToOtherSlot() = 0;
+    virtual bool switchSlot() = 0;
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // Latency probe, processes a copy of the current A/B slot offline on a worker thread to measure its latency.
+    // Called from the UI thread: startLatencyProbe() returns false if a probe is not possible right now,
+    // otherwise call finishLatencyProbe() until it returns true, after which the result is available.
+    // When enabled, the measured latency replaces the reported one while the plugins keep reporting the same.
+    virtual bool startLatencyProbe() = 0;
+    virtual bool finishLatencyProbe() = 0;
+    virtual bool getLatencyProbeResult(IldaeilLatencyProbeResult& result) const = 0;
+    virtual bool getUseProbedLatency() const = 0;
+    virtual void setUseProbedLatency(bool use) = 0;
+   #endif
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // Parallel layers, extra racks getting the same MIDI as the main one (or a key/velocity split of it),
+    // each rendered on its own worker thread and mixed into the main output, padded up to the largest layer latency.
+    // Layer 0 is the main rack.
+    // All called from the UI thread, selecting a layer changes the rack shown in the UI.
+    // Gapless swap and A/B slots are only available while the main rack is selected.
+    virtual uint getLayerCount() const = 0;
+    virtual uint getSelectedLayer() const = 0;
+    virtual void selectLayer(uint layer) = 0;
+    virtual bool addLayer() = 0;
+    // Returns false if there is only the main rack or the last layer is selected, select another one first.
+    virtual bool removeLastLayer() = 0;
+    virtual IldaeilLayerSplit getLayerSplit(uint layer) const = 0;
+    virtual void setLayerSplit(uint layer, const IldaeilLayerSplit& split) = 0;
+   #endif
 };
 
 // --------------------------------------------------------------------------------------------------------------------
 
 void ildaeilProjectLoadedFromDSP(void* ui);
-void ildaeilParameterChangeForUI(void* ui, uint32_t index, float value);
+void ildaeilParameterChangeForUI(void* ui, uint queue, uint32_t index, float value);
 void ildaeilResizeUI(void* ui, uint32_t width, uint32_t height);
 void ildaeilCloseUI(void* ui);
 const char* ildaeilOpenFileForUI(void* ui, bool isDir, const char* title, const char* filter);
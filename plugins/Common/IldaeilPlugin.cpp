@@ -16,13 +16,28 @@
  */
 
 #include "IldaeilBasePlugin.hpp"
+#include "LatencyProbe.hpp"
 #include "DistrhoPluginUtils.hpp"
+#include "extra/Time.hpp"
+
+#include "extra/Thread.hpp"
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+# include "extra/Semaphore.hpp"
+#endif
 
 #include "CarlaBackendUtils.hpp"
 #include "CarlaEngine.hpp"
+#include "CarlaPlugin.hpp"
+#include "CarlaStateUtils.hpp"
 #include "water/files/File.h"
 #include "water/streams/MemoryOutputStream.h"
 #include "water/xml/XmlDocument.h"
+#include "water/xml/XmlElement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
 
 START_NAMESPACE_DISTRHO
 
@@ -30,6 +45,27 @@ using namespace CARLA_BACKEND_NAMESPACE;
 
 // --------------------------------------------------------------------------------------------------------------------
 
+// UI parameter queue of the thread processing a rack right now, 0 when not processing (see IldaeilBasePlugin.hpp)
+static thread_local uint sParameterQueue = 0;
+
+// Sets the queue for the current thread while processing a rack, restoring the previous one afterwards.
+struct ScopedParameterQueue {
+    const uint previous;
+
+    explicit ScopedParameterQueue(const uint queue) noexcept
+        : previous(sParameterQueue)
+    {
+        sParameterQueue = queue;
+    }
+
+    ~ScopedParameterQueue() noexcept
+    {
+        sParameterQueue = previous;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
 static uint32_t host_get_buffer_size(NativeHostHandle);
 static double host_get_sample_rate(NativeHostHandle);
 static bool host_is_offline(NativeHostHandle);
@@ -316,6 +352,311 @@ const char* IldaeilBasePlugin::getPluginPath(const PluginType ptype)
 
 // --------------------------------------------------------------------------------------------------------------------
 
+bool IldaeilBasePlugin::savePluginState(const CarlaHostHandle handle, const uint pluginId, String& state)
+{
+    CarlaEngine* const engine = carla_get_engine_from_handle(handle);
+    DISTRHO_SAFE_ASSERT_RETURN(engine != nullptr, false);
+
+    const CarlaPluginPtr plugin = engine->getPlugin(pluginId);
+    DISTRHO_SAFE_ASSERT_RETURN(plugin.get() != nullptr, false);
+
+    // same format as carla_save_plugin_state, without going through a file
+    water::MemoryOutputStream stream;
+    stream << "<?xml version='1.0' encoding='UTF-8'?>\n";
+    stream << "<!DOCTYPE CARLA-PRESET>\n";
+    stream << "<CARLA-PRESET VERSION='2.0'>\n";
+    plugin->getStateSave(true).dumpToMemoryStream(stream);
+    stream << "</CARLA-PRESET>\n";
+
+    state = String(static_cast<char*>(stream.getDataAndRelease()), false);
+    return true;
+}
+
+bool IldaeilBasePlugin::loadPluginState(const CarlaHostHandle handle, const uint pluginId, const char* const state)
+{
+    CarlaEngine* const engine = carla_get_engine_from_handle(handle);
+    DISTRHO_SAFE_ASSERT_RETURN(engine != nullptr, false);
+
+    const CarlaPluginPtr plugin = engine->getPlugin(pluginId);
+    DISTRHO_SAFE_ASSERT_RETURN(plugin.get() != nullptr, false);
+
+    water::XmlDocument xml(state);
+    const std::unique_ptr<water::XmlElement> xmlElement(xml.getDocumentElement());
+    DISTRHO_SAFE_ASSERT_RETURN(xmlElement != nullptr, false);
+
+    CarlaStateSave stateSave;
+    if (! stateSave.fillFromXmlElement(xmlElement.get()))
+        return false;
+
+    // loadStateSave reports nothing and applies whatever matches, so refuse states saved from another plugin
+    char label[STR_MAX] = {};
+    if (getPluginTypeFromString(stateSave.type) != plugin->getType() || ! plugin->getLabel(label)
+        || std::strcmp(label, stateSave.label != nullptr ? stateSave.label : "") != 0)
+    {
+        d_stderr("Plugin state does not belong to plugin %u, not restoring it", pluginId);
+        return false;
+    }
+
+    plugin->loadStateSave(stateSave);
+    return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Stereo ring buffer, written once per audio block and read back some frames later.
+// Sized with resize() from the block size and longest delay needed, before processing.
+
+struct IldaeilDelayLine
+{
+    float* buffer = nullptr;
+    // power of 2, in frames per channel
+    uint32_t size = 0;
+    uint32_t pos = 0;
+
+    IldaeilDelayLine() noexcept {}
+
+    ~IldaeilDelayLine()
+    {
+        delete[] buffer;
+    }
+
+    // Make room for delays up to maxDelay with blocks of up to maxFrames, not realtime safe.
+    void resize(const uint32_t maxDelay, const uint32_t maxFrames)
+    {
+        const uint32_t newSize = d_nextPowerOf2(maxDelay + maxFrames);
+
+        if (newSize != size)
+        {
+            delete[] buffer;
+            buffer = new float[newSize * 2];
+            size = newSize;
+        }
+
+        clear();
+    }
+
+    void clear()
+    {
+        if (buffer != nullptr)
+            std::memset(buffer, 0, sizeof(float)*size*2);
+        pos = 0;
+    }
+
+    void write(const float* const* const inputs, const uint32_t frames)
+    {
+        DISTRHO_SAFE_ASSERT_UINT2_RETURN(frames <= size, frames, size,);
+
+        const uint32_t first = std::min(frames, size - pos);
+
+        for (uint c = 0; c < 2; ++c)
+        {
+            float* const channel = buffer + size * c;
+            std::memcpy(channel + pos, inputs[c], sizeof(float)*first);
+            std::memcpy(channel, inputs[c] + first, sizeof(float)*(frames - first));
+        }
+
+        pos = (pos + frames) & (size - 1);
+    }
+
+    // Position matching the start of the block just written, going back by delay frames.
+    // Delays longer than the line was sized for are clamped, the callers limit them to that already.
+    uint32_t getReadPos(const uint32_t frames, const uint32_t delay) const noexcept
+    {
+        DISTRHO_SAFE_ASSERT_UINT2(delay + frames <= size, delay, size);
+
+        return (pos - frames - std::min(delay, size - frames)) & (size - 1);
+    }
+
+    void read(float** const outputs, const uint32_t frames, const uint32_t delay) const
+    {
+        const uint32_t readPos = getReadPos(frames, delay);
+
+        for (uint c = 0; c < 2; ++c)
+        {
+            float* const out = outputs[c];
+            const float* const channel = buffer + size * c;
+
+            for (uint32_t i = 0; i < frames; ++i)
+                out[i] = channel[(readPos + i) & (size - 1)];
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(IldaeilDelayLine)
+};
+
+#if DISTRHO_PLUGIN_NUM_INPUTS != 0
+// --------------------------------------------------------------------------------------------------------------------
+// Measures the actual latency of a rack, processing it offline on a worker thread.
+// See LatencyProbeCorrelation for how the signal is generated and the latency found.
+
+struct IldaeilLatencyProbe : public Thread
+{
+    IldaeilRack rack;
+    const NativePluginDescriptor* descriptor = nullptr;
+    uint32_t bufferSize = 0;
+    double sampleRate = 0.0;
+    // outside of the host timeline, always stopped at frame 0
+    const NativeTimeInfo timeInfo{};
+
+    // written by the worker, valid once it is not running anymore
+    int32_t measured = -1;
+
+    IldaeilLatencyProbe()
+        : Thread("IldaeilLatencyProbe") {}
+
+protected:
+    void run() override
+    {
+        LatencyProbeCorrelation correlation;
+        correlation.reset(sampleRate);
+        measured = -1;
+
+        // 2 inputs and 2 outputs
+        float* const buffer = new float[bufferSize * 4];
+        float* inputs[2] = { buffer, buffer + bufferSize };
+        float* outputs[2] = { buffer + bufferSize * 2, buffer + bufferSize * 3 };
+
+        // always full blocks, anything past the end is ignored
+        for (uint32_t offset = 0; offset < correlation.end; offset += bufferSize)
+        {
+            if (shouldThreadExit())
+            {
+                delete[] buffer;
+                return;
+            }
+
+            correlation.fillInput(inputs, offset, bufferSize);
+            descriptor->process(rack.pluginHandle, inputs, outputs, bufferSize, nullptr, 0);
+            correlation.addOutput(outputs, offset, bufferSize);
+        }
+
+        measured = correlation.getMeasured();
+
+        delete[] buffer;
+    }
+};
+#endif
+
+#if DISTRHO_PLUGIN_IS_SYNTH
+// --------------------------------------------------------------------------------------------------------------------
+// An extra layer, with its own rack and a worker thread rendering it in parallel to the main rack.
+// Once per block the audio thread fills in the process data, posts processStart and waits on processDone.
+
+struct IldaeilLayer : public Thread
+{
+    IldaeilRack rack;
+    const NativePluginDescriptor* descriptor = nullptr;
+    uint parameterQueue = 0;
+
+    // latency of the rack as of the last block, and the padding that lines its output up with the other layers.
+    // only used by the audio thread
+    uint32_t latency = 0;
+    IldaeilDelayLine delay;
+
+    // only touched by the audio thread while the worker is waiting
+    float** inputs = nullptr;
+    float* outputs[2] = {};
+    uint32_t frames = 0;
+    NativeMidiEvent* midiEvents = nullptr;
+    uint32_t midiEventCount = 0;
+
+    Semaphore processStart;
+    Semaphore processDone;
+
+    IldaeilLayer()
+        : Thread("IldaeilLayer") {}
+
+    void process()
+    {
+        const ScopedParameterQueue spq(parameterQueue);
+        descriptor->process(rack.pluginHandle, inputs, outputs, frames, midiEvents, midiEventCount);
+    }
+
+    void stop()
+    {
+        if (! isThreadRunning())
+            return;
+
+        signalThreadShouldExit();
+        processStart.post();
+        stopThread(-1);
+    }
+
+protected:
+    void run() override
+    {
+        for (;;)
+        {
+            processStart.wait();
+
+            if (shouldThreadExit())
+                break;
+
+            process();
+            processDone.post();
+        }
+    }
+};
+
+// layer splits are packed into 32bit values so the audio thread can read them atomically
+static uint32_t packLayerSplit(const IldaeilLayerSplit& split) noexcept
+{
+    return static_cast<uint32_t>(split.lowKey)
+         | static_cast<uint32_t>(split.highKey) << 8
+         | static_cast<uint32_t>(split.lowVelocity) << 16
+         | static_cast<uint32_t>(split.highVelocity) << 24;
+}
+
+static IldaeilLayerSplit unpackLayerSplit(const uint32_t packed) noexcept
+{
+    IldaeilLayerSplit split;
+    split.lowKey = packed & 0xff;
+    split.highKey = (packed >> 8) & 0xff;
+    split.lowVelocity = (packed >> 16) & 0xff;
+    split.highVelocity = packed >> 24;
+    return split;
+}
+
+static const uint32_t kFullLayerSplit = packLayerSplit(IldaeilLayerSplit());
+
+// Copy the MIDI events a layer should receive, source and destination can be the same.
+// Only note-ons are split, everything else (including note-offs, so notes never hang) goes to all layers.
+static uint32_t copyMidiEventsForLayer(const NativeMidiEvent* const events, const uint32_t eventCount,
+                                       NativeMidiEvent* const layerEvents, const uint32_t packedSplit)
+{
+    if (packedSplit == kFullLayerSplit)
+    {
+        if (layerEvents != events)
+            std::memcpy(layerEvents, events, sizeof(NativeMidiEvent)*eventCount);
+        return eventCount;
+    }
+
+    const IldaeilLayerSplit split(unpackLayerSplit(packedSplit));
+    uint32_t layerEventCount = 0;
+
+    for (uint32_t i = 0; i < eventCount; ++i)
+    {
+        const NativeMidiEvent& event(events[i]);
+
+        if (event.size == 3 && (event.data[0] & 0xf0) == 0x90 && event.data[2] != 0)
+        {
+            const uint8_t key = event.data[1];
+            const uint8_t velocity = event.data[2];
+
+            if (key < split.lowKey || key > split.highKey)
+                continue;
+            if (velocity < split.lowVelocity || velocity > split.highVelocity)
+                continue;
+        }
+
+        layerEvents[layerEventCount++] = event;
+    }
+
+    return layerEventCount;
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+
 class IldaeilPlugin : public IldaeilBasePlugin
 {
    #if DISTRHO_PLUGIN_NUM_INPUTS == 0 || DISTRHO_PLUGIN_NUM_OUTPUTS == 0
@@ -327,10 +668,105 @@ class IldaeilPlugin : public IldaeilBasePlugin
     NativeMidiEvent* fMidiEvents = nullptr;
    #endif
 
-    mutable NativeTimeInfo fCarlaTimeInfo{};
+    // 2 racks, one being processed and another where plugin replacements are loaded
+    IldaeilRack fRacks[2];
+    std::atomic<uint> fFrontRack { 0 };
+    // rack of the A/B slot in use, shown in the UI unless another layer is selected
+    uint fCurrentSlot = 0;
+    bool fActive = false;
+    // whether the rack not in use holds an A/B slot, otherwise it is only used for plugin swaps
+    bool fOtherSlotInUse = false;
+    // A/B slot restored by the host while crossfading, loaded once the crossfade ends (see finishPluginSwap).
+    // protected by sPluginInfoLoadMutex
+    String fPendingOtherSlotState;
+    bool fOtherSlotStatePending = false;
+
+    // crossfade between racks, fCrossfading is set by the UI thread and cleared by the audio thread when done.
+    // the time in ms is an option changed from the UI and host threads, see getCrossfadeTime.
+    static constexpr const uint kDefaultCrossfadeTime = 50;
+    std::atomic<bool> fCrossfading { false };
+    std::atomic<uint> fCrossfadeTime { kDefaultCrossfadeTime };
+    uint fCrossfadeTarget = 0;
+    uint32_t fCrossfadeFrame = 0;
+    uint32_t fCrossfadeLength = 0;
+    float* fCrossfadeBuffer = nullptr;
+    uint32_t fCrossfadeBufferSize = 0;
+
+    // longest latency the delay lines below compensate for in ms, and in frames at the current sample rate.
+    // the dry signal of plugins with a longer latency than this is not fully delayed.
+    static constexpr const uint kMaxCompensatedLatency = 1000;
+    uint32_t fMaxDelay = 0;
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // input, read back delayed by the wet signal latency so the dry signal lines up with it
+    IldaeilDelayLine fDryDelay;
+    float fDryWet = 1.f;
+   #endif
+   #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+    // output of the hosted plugins, padded up to the reported latency when that is higher than their own
+    IldaeilDelayLine fWetDelay;
+
+    // bypass ramps the output of the hosted plugins down, once silent they are not processed anymore
+    static constexpr const uint kBypassRampTime = 20;
+    bool fBypassed = false;
+    float fWetGain = 1.f;
+   #endif
+    // set while bypassed, notes that were playing get stopped once processing resumes
+    bool fProcessingSkipped = false;
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // extra layers, fLayerCount includes the main rack.
+    // the audio thread sets fLayersBusy while using the layers, so the UI thread knows when it can remove one.
+    // layers are added and removed from both the UI and host threads (on setState), one at a time through
+    // fLayerMutex, but only the UI thread changes the selected layer.
+    IldaeilLayer fLayers[kIldaeilMaxLayers - 1];
+    std::atomic<uint> fLayerCount { 1 };
+    std::atomic<bool> fLayersBusy { false };
+    std::atomic<uint32_t> fLayerSplits[kIldaeilMaxLayers];
+    std::atomic<uint> fSelectedLayer { 0 };
+    Mutex fLayerMutex;
+    // same as the layer latency and padding, for the main rack
+    uint32_t fMainLayerLatency = 0;
+    IldaeilDelayLine fMainLayerDelay;
+    NativeMidiEvent* fLayerMidiEvents = nullptr;
+    float* fLayerBuffer = nullptr;
+   #endif
+
+    String fResourcePath;
+
+    // filled by the audio thread at the start of each block, before any rack processes, racks only read it
+    NativeTimeInfo fCarlaTimeInfo{};
     mutable water::MemoryOutputStream fLastProjectState;
+
+    // latency changes are only reported to the host after staying the same for kLatencyDebounceTime,
+    // so plugins that move it around all the time do not make the host recompensate on every block.
+    static constexpr const uint kLatencyDebounceTime = 500;
+   #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+    // a fixed latency (in ms, 0 if off) is reported instead whenever it covers the one of the hosted plugins.
+    // needs audio outputs to pad the hosted plugins up to it.
+    static constexpr const uint kMaxFixedLatency = 500;
+    uint fFixedLatency = 0;
+   #endif
+    uint32_t fPluginLatency = 0;
+    uint32_t fPendingLatency = 0;
+    uint32_t fPendingLatencyFrames = 0;
     uint32_t fLastLatencyValue = 0;
 
+    // editor option, see getKeepEmbedUI
+    std::atomic<bool> fKeepEmbedUI { false };
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // latency probe, its rack is only used by the worker while running.
+    // the result is kept along with the rack it was measured on and what its plugins reported at the time,
+    // if enabled the audio thread uses the measured latency while those still match.
+    IldaeilLatencyProbe fLatencyProbe;
+    std::atomic<bool> fLatencyProbeValid { false };
+    std::atomic<bool> fUseProbedLatency { false };
+    CarlaHostHandle fLatencyProbeHandle = nullptr;
+    uint32_t fLatencyProbeReported = 0;
+    int32_t fLatencyProbeMeasured = -1;
+   #endif
+
 public:
     IldaeilPlugin()
         : IldaeilBasePlugin()
@@ -338,31 +774,6 @@ public:
         fCarlaPluginDescriptor = carla_get_native_rack_plugin();
         DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginDescriptor != nullptr,);
 
-        fCarlaHostDescriptor.handle = this;
-        fCarlaHostDescriptor.resourceDir = carla_get_library_folder();
-        fCarlaHostDescriptor.uiName = "Ildaeil";
-        fCarlaHostDescriptor.uiParentId = 0;
-
-        fCarlaHostDescriptor.get_buffer_size = host_get_buffer_size;
-        fCarlaHostDescriptor.get_sample_rate = host_get_sample_rate;
-        fCarlaHostDescriptor.is_offline = host_is_offline;
-
-        fCarlaHostDescriptor.get_time_info = host_get_time_info;
-        fCarlaHostDescriptor.write_midi_event = host_write_midi_event;
-        fCarlaHostDescriptor.ui_parameter_changed = host_ui_parameter_changed;
-        fCarlaHostDescriptor.ui_midi_program_changed = host_ui_midi_program_changed;
-        fCarlaHostDescriptor.ui_custom_data_changed = host_ui_custom_data_changed;
-        fCarlaHostDescriptor.ui_closed = host_ui_closed;
-        fCarlaHostDescriptor.ui_open_file = host_ui_open_file;
-        fCarlaHostDescriptor.ui_save_file = host_ui_save_file;
-        fCarlaHostDescriptor.dispatcher = host_dispatcher;
-
-        fCarlaPluginHandle = fCarlaPluginDescriptor->instantiate(&fCarlaHostDescriptor);
-        DISTRHO_SAFE_ASSERT_RETURN(fCarlaPluginHandle != nullptr,);
-
-        fCarlaHostHandle = carla_create_native_plugin_host_handle(fCarlaPluginDescriptor, fCarlaPluginHandle);
-        DISTRHO_SAFE_ASSERT_RETURN(fCarlaHostHandle != nullptr,);
-
         const char* const bundlePath = getBundlePath();
        #ifdef CARLA_OS_WIN
         #define EXT ".exe"
@@ -374,8 +785,7 @@ public:
             && water::File(bundlePath + String(DISTRHO_OS_SEP_STR "carla-bridge-native" EXT)).existsAsFile())
         {
             fBinaryPath = bundlePath;
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_BINARIES, 0, bundlePath);
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_RESOURCES, 0, getResourcePath(bundlePath));
+            fResourcePath = getResourcePath(bundlePath);
         }
        #ifdef CARLA_OS_MAC
         else if (bundlePath != nullptr
@@ -383,20 +793,17 @@ public:
         {
             fBinaryPath = bundlePath;
             fBinaryPath += "/Contents/MacOS";
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_BINARIES, 0, fBinaryPath);
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_RESOURCES, 0, getResourcePath(bundlePath));
+            fResourcePath = getResourcePath(bundlePath);
         }
        #endif
         else
         {
            #ifdef CARLA_OS_MAC
             fBinaryPath = "/Applications/Carla.app/Contents/MacOS";
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_BINARIES, 0, "/Applications/Carla.app/Contents/MacOS");
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_RESOURCES, 0, "/Applications/Carla.app/Contents/MacOS/resources");
+            fResourcePath = "/Applications/Carla.app/Contents/MacOS/resources";
            #else
             fBinaryPath = "/usr/lib/carla";
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_BINARIES, 0, "/usr/lib/carla");
-            carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PATH_RESOURCES, 0, "/usr/share/carla/resources");
+            fResourcePath = "/usr/share/carla/resources";
            #endif
         }
 
@@ -405,135 +812,670 @@ public:
 
         #undef EXT
 
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_LADSPA, getPluginPath(PLUGIN_LADSPA));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_DSSI, getPluginPath(PLUGIN_DSSI));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_LV2, getPluginPath(PLUGIN_LV2));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_VST2, getPluginPath(PLUGIN_VST2));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_VST3, getPluginPath(PLUGIN_VST3));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_CLAP, getPluginPath(PLUGIN_CLAP));
-        carla_set_engine_option(fCarlaHostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_JSFX, getPluginPath(PLUGIN_JSFX));
+        // the 2nd rack is only created once a plugin swap is requested
+        DISTRHO_SAFE_ASSERT_RETURN(initRack(fRacks[0]),);
 
-        fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_HOST_USES_EMBED,
-                                           0, 0, nullptr, 0.0f);
+        fCarlaPluginHandle.store(fRacks[0].pluginHandle, std::memory_order_release);
+        fCarlaHostHandle.store(fRacks[0].hostHandle, std::memory_order_release);
+
+        // defaults for the options, until restored from a saved state
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        if (const char* const crossfadeTime = std::getenv("ILDAEIL_CROSSFADE_MS"))
+            setCrossfadeTime(std::max(0, std::atoi(crossfadeTime)));
+       #else
+        // nothing to fade, swap on the next audio block
+        fCrossfadeTime = 0;
+       #endif
+
+        if (const char* const keepEmbedUI = std::getenv("ILDAEIL_KEEP_EMBED_UI"))
+            setKeepEmbedUI(std::atoi(keepEmbedUI) != 0);
 
        #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
         fMidiEvents = new NativeMidiEvent[kMaxMidiEventCount];
        #endif
 
-       #if DISTRHO_PLUGIN_NUM_INPUTS == 0 || DISTRHO_PLUGIN_NUM_OUTPUTS == 0
-        // create dummy buffers
-        bufferSizeChanged(getBufferSize());
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fLatencyProbe.descriptor = fCarlaPluginDescriptor;
+        fLatencyProbe.rack.offline = true;
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        fLayerMidiEvents = new NativeMidiEvent[kMaxMidiEventCount * (kIldaeilMaxLayers - 1)];
+
+        for (uint i = 0; i < kIldaeilMaxLayers - 1; ++i)
+        {
+            fLayers[i].descriptor = fCarlaPluginDescriptor;
+            fLayers[i].parameterQueue = kIldaeilParameterQueueAudio + 1 + i;
+            fLayers[i].inputs = fDummyBuffers;
+            fLayers[i].midiEvents = fLayerMidiEvents + kMaxMidiEventCount * i;
+        }
+
+        for (uint i = 0; i < kIldaeilMaxLayers; ++i)
+            fLayerSplits[i].store(kFullLayerSplit, std::memory_order_relaxed);
        #endif
+
+        // create dummy, crossfade and layer buffers
+        bufferSizeChanged(getBufferSize());
     }
 
     ~IldaeilPlugin() override
     {
-        if (fCarlaHostHandle != nullptr)
+        for (IldaeilRack& rack : fRacks)
+            cleanupRack(rack);
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fLatencyProbe.stopThread(-1);
+        cleanupRack(fLatencyProbe.rack);
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        for (IldaeilLayer& layer : fLayers)
         {
-            carla_host_handle_free(fCarlaHostHandle);
-           #if DISTRHO_PLUGIN_NUM_INPUTS == 0 || DISTRHO_PLUGIN_NUM_OUTPUTS == 0
-            delete[] fDummyBuffer;
-           #endif
-           #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
-            delete[] fMidiEvents;
-           #endif
+            layer.stop();
+            cleanupRack(layer.rack);
         }
 
-        if (fCarlaPluginHandle != nullptr)
-            fCarlaPluginDescriptor->cleanup(fCarlaPluginHandle);
+        delete[] fLayerMidiEvents;
+        delete[] fLayerBuffer;
+       #endif
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS == 0 || DISTRHO_PLUGIN_NUM_OUTPUTS == 0
+        delete[] fDummyBuffer;
+       #endif
+       #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
+        delete[] fMidiEvents;
+       #endif
+        delete[] fCrossfadeBuffer;
     }
 
-    const NativeTimeInfo* hostGetTimeInfo() const noexcept
+    bool initRack(IldaeilRack& rack)
     {
-        const TimePosition& timePos(getTimePosition());
-
-        fCarlaTimeInfo.playing = timePos.playing;
-        fCarlaTimeInfo.frame = timePos.frame;
-        fCarlaTimeInfo.bbt.valid = timePos.bbt.valid;
-        fCarlaTimeInfo.bbt.bar = timePos.bbt.bar;
-        fCarlaTimeInfo.bbt.beat = timePos.bbt.beat;
-        fCarlaTimeInfo.bbt.tick = timePos.bbt.tick;
-        fCarlaTimeInfo.bbt.barStartTick = timePos.bbt.barStartTick;
-        fCarlaTimeInfo.bbt.beatsPerBar = timePos.bbt.beatsPerBar;
-        fCarlaTimeInfo.bbt.beatType = timePos.bbt.beatType;
-        fCarlaTimeInfo.bbt.ticksPerBeat = timePos.bbt.ticksPerBeat;
-        fCarlaTimeInfo.bbt.beatsPerMinute = timePos.bbt.beatsPerMinute;
+        rack.plugin = this;
+
+        NativeHostDescriptor& hostDescriptor(rack.hostDescriptor);
+        hostDescriptor.handle = &rack;
+        hostDescriptor.resourceDir = carla_get_library_folder();
+        hostDescriptor.uiName = "Ildaeil";
+        hostDescriptor.uiParentId = 0;
+
+        hostDescriptor.get_buffer_size = host_get_buffer_size;
+        hostDescriptor.get_sample_rate = host_get_sample_rate;
+        hostDescriptor.is_offline = host_is_offline;
+
+        hostDescriptor.get_time_info = host_get_time_info;
+        hostDescriptor.write_midi_event = host_write_midi_event;
+        hostDescriptor.ui_parameter_changed = host_ui_parameter_changed;
+        hostDescriptor.ui_midi_program_changed = host_ui_midi_program_changed;
+        hostDescriptor.ui_custom_data_changed = host_ui_custom_data_changed;
+        hostDescriptor.ui_closed = host_ui_closed;
+        hostDescriptor.ui_open_file = host_ui_open_file;
+        hostDescriptor.ui_save_file = host_ui_save_file;
+        hostDescriptor.dispatcher = host_dispatcher;
+
+        rack.pluginHandle = fCarlaPluginDescriptor->instantiate(&hostDescriptor);
+        DISTRHO_SAFE_ASSERT_RETURN(rack.pluginHandle != nullptr, false);
+
+        rack.hostHandle = carla_create_native_plugin_host_handle(fCarlaPluginDescriptor, rack.pluginHandle);
+        DISTRHO_SAFE_ASSERT_RETURN(rack.hostHandle != nullptr, false);
+
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PATH_BINARIES, 0, fBinaryPath);
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PATH_RESOURCES, 0, fResourcePath);
+
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_LADSPA, getPluginPath(PLUGIN_LADSPA));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_DSSI, getPluginPath(PLUGIN_DSSI));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_LV2, getPluginPath(PLUGIN_LV2));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_VST2, getPluginPath(PLUGIN_VST2));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_VST3, getPluginPath(PLUGIN_VST3));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_CLAP, getPluginPath(PLUGIN_CLAP));
+        carla_set_engine_option(rack.hostHandle, ENGINE_OPTION_PLUGIN_PATH, PLUGIN_JSFX, getPluginPath(PLUGIN_JSFX));
+
+        fCarlaPluginDescriptor->dispatcher(rack.pluginHandle, NATIVE_PLUGIN_OPCODE_HOST_USES_EMBED,
+                                           0, 0, nullptr, 0.0f);
 
-        return &fCarlaTimeInfo;
+        return true;
     }
 
-#if DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
-    bool hostWriteMidiEvent(const NativeMidiEvent* const event)
+    void cleanupRack(IldaeilRack& rack)
     {
-        MidiEvent midiEvent;
-        midiEvent.frame = event->time;
-        midiEvent.size = event->size;
-        midiEvent.dataExt = nullptr;
-
-        uint32_t i = 0;
-        for (; i < event->size; ++i)
-            midiEvent.data[i] = event->data[i];
-        for (; i < MidiEvent::kDataSize; ++i)
-            midiEvent.data[i] = 0;
+        if (rack.hostHandle != nullptr)
+            carla_host_handle_free(rack.hostHandle);
 
-        return writeMidiEvent(midiEvent);
+        if (rack.pluginHandle != nullptr)
+            fCarlaPluginDescriptor->cleanup(rack.pluginHandle);
     }
-#endif
 
-    intptr_t hostDispatcher(const NativeHostDispatcherOpcode opcode,
-                            const int32_t index, const intptr_t value, void* const ptr, const float opt)
+    void activateRack(IldaeilRack& rack)
     {
-        switch (opcode)
-        {
-        // cannnot be supported
-        case NATIVE_HOST_OPCODE_HOST_IDLE:
-            break;
-        // other stuff
-        case NATIVE_HOST_OPCODE_NULL:
-        case NATIVE_HOST_OPCODE_UPDATE_PARAMETER:
-        case NATIVE_HOST_OPCODE_UPDATE_MIDI_PROGRAM:
-        case NATIVE_HOST_OPCODE_RELOAD_PARAMETERS:
-        case NATIVE_HOST_OPCODE_RELOAD_MIDI_PROGRAMS:
-        case NATIVE_HOST_OPCODE_RELOAD_ALL:
-        case NATIVE_HOST_OPCODE_UI_UNAVAILABLE:
-        case NATIVE_HOST_OPCODE_INTERNAL_PLUGIN:
-        case NATIVE_HOST_OPCODE_QUEUE_INLINE_DISPLAY:
-        case NATIVE_HOST_OPCODE_UI_TOUCH_PARAMETER:
-        case NATIVE_HOST_OPCODE_REQUEST_IDLE:
-        case NATIVE_HOST_OPCODE_GET_FILE_PATH:
-        case NATIVE_HOST_OPCODE_PREVIEW_BUFFER_DATA:
-            // TESTING
-            d_stdout("dispatcher %i:%s, %i, %li, %p, %f",
-                      opcode, NativeHostDispatcherOpcode2Str(opcode), index, value, ptr, opt);
-            break;
-        case NATIVE_HOST_OPCODE_UI_RESIZE:
-            ildaeilResizeUI(fUI, index, value);
-            break;
-        }
+        if (rack.pluginHandle == nullptr || rack.active)
+            return;
 
-        return 0;
+        rack.active = true;
+        fCarlaPluginDescriptor->activate(rack.pluginHandle);
     }
 
-protected:
-   /* --------------------------------------------------------------------------------------------------------
-    * Information */
-
-    const char* getLabel() const override
+    void deactivateRack(IldaeilRack& rack)
     {
-#if ILDAEIL_STANDALONE
-        return "Ildaeil";
-#elif DISTRHO_PLUGIN_IS_SYNTH
-        return "IldaeilSynth";
-#elif DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
-        return "IldaeilMIDI";
-#else
-        return "IldaeilFX";
-#endif
+        if (rack.pluginHandle == nullptr || ! rack.active)
+            return;
+
+        rack.active = false;
+        fCarlaPluginDescriptor->deactivate(rack.pluginHandle);
     }
 
-    const char* getDescription() const override
+    bool isAudioRack(const IldaeilRack* const rack) const noexcept
     {
-        return "Ildaeil is a mini-plugin host working as a plugin, allowing one-to-one plugin format reusage.";
+        return rack == &fRacks[fFrontRack.load(std::memory_order_acquire)];
+    }
+
+    bool isUIRack(const IldaeilRack* const rack) const noexcept
+    {
+        return rack->hostHandle == fCarlaHostHandle.load(std::memory_order_acquire);
+    }
+
+   /* --------------------------------------------------------------------------------------------------------
+    * Options */
+
+    uint getCrossfadeTime() const override
+    {
+        return fCrossfadeTime.load(std::memory_order_relaxed);
+    }
+
+    void setCrossfadeTime(const uint ms) override
+    {
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        fCrossfadeTime.store(std::min(ms, kIldaeilMaxCrossfadeTime), std::memory_order_relaxed);
+       #else
+        // nothing to fade
+        (void)ms;
+       #endif
+    }
+
+    bool getKeepEmbedUI() const override
+    {
+        return fKeepEmbedUI.load(std::memory_order_relaxed);
+    }
+
+    void setKeepEmbedUI(const bool keep) override
+    {
+        fKeepEmbedUI.store(keep, std::memory_order_relaxed);
+    }
+
+   /* --------------------------------------------------------------------------------------------------------
+    * Plugin swap */
+
+    CarlaHostHandle getSwapHostHandle() override
+    {
+        if (fCarlaPluginDescriptor == nullptr || fCrossfading.load(std::memory_order_acquire))
+            return nullptr;
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        if (fSelectedLayer != 0)
+            return nullptr;
+       #endif
+
+        IldaeilRack& rack(fRacks[1 - fFrontRack.load(std::memory_order_acquire)]);
+
+        if (rack.pluginHandle == nullptr)
+        {
+            const MutexLocker cml(sPluginInfoLoadMutex);
+
+            if (! initRack(rack))
+                return nullptr;
+        }
+
+        // tear down whatever a previous swap left behind, in case its UI was closed before it could
+        finishPluginSwap();
+
+        // holds the inactive A/B slot
+        if (carla_get_current_plugin_count(rack.hostHandle) != 0)
+            return nullptr;
+
+        // keep it inactive while loading, so carla does not wait on the audio thread which does not process it yet
+        DISTRHO_SAFE_ASSERT_RETURN(! rack.active, nullptr);
+
+        return rack.hostHandle;
+    }
+
+    void startPluginSwap() override
+    {
+        const uint target = 1 - fFrontRack.load(std::memory_order_acquire);
+        IldaeilRack& rack(fRacks[target]);
+        DISTRHO_SAFE_ASSERT_RETURN(rack.hostHandle != nullptr,);
+
+        fCurrentSlot = target;
+        fCarlaPluginHandle.store(rack.pluginHandle, std::memory_order_release);
+        fCarlaHostHandle.store(rack.hostHandle, std::memory_order_release);
+
+        if (! fActive)
+        {
+            fFrontRack.store(target, std::memory_order_release);
+            return;
+        }
+
+        activateRack(rack);
+
+        fCrossfadeTarget = target;
+        fCrossfadeFrame = 0;
+        fCrossfadeLength = static_cast<uint32_t>(getCrossfadeTime() * getSampleRate() / 1000.0);
+
+        // the audio thread takes over from here
+        fCrossfading.store(true, std::memory_order_release);
+    }
+
+    bool finishPluginSwap() override
+    {
+        if (fCrossfading.load(std::memory_order_acquire))
+            return false;
+
+        IldaeilRack& rack(fRacks[1 - fFrontRack.load(std::memory_order_acquire)]);
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+
+        if (rack.hostHandle != nullptr)
+        {
+            // not processed anymore, put to sleep and tear down the old plugin here instead of the audio thread
+            deactivateRack(rack);
+
+            if (! fOtherSlotInUse)
+                carla_remove_all_plugins(rack.hostHandle);
+        }
+
+        if (fOtherSlotStatePending)
+        {
+            // called from the UI thread, where these details are used
+            fOtherSlotDetails = PluginSlot();
+            loadPendingOtherSlotState();
+        }
+
+        return true;
+    }
+
+   /* --------------------------------------------------------------------------------------------------------
+    * A/B slots */
+
+    uint getCurrentSlot() const override
+    {
+        return fCurrentSlot;
+    }
+
+    CarlaHostHandle getOtherSlotHostHandle() override
+    {
+        return fOtherSlotInUse ? fRacks[1 - getCurrentSlot()].hostHandle : nullptr;
+    }
+
+    bool copyToOtherSlot() override
+    {
+        if (fCarlaPluginDescriptor == nullptr || fCrossfading.load(std::memory_order_acquire))
+            return false;
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        if (fSelectedLayer != 0)
+            return false;
+       #endif
+
+        IldaeilRack& rack(fRacks[1 - getCurrentSlot()]);
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+
+        if (rack.pluginHandle == nullptr && ! initRack(rack))
+            return false;
+
+        water::MemoryOutputStream project;
+        carla_get_engine_from_handle(fRacks[fCurrentSlot].hostHandle)->saveProjectInternal(project);
+
+        const water::String wproject(project.toString());
+        water::XmlDocument xml(wproject);
+
+        carla_remove_all_plugins(rack.hostHandle);
+        carla_get_engine_from_handle(rack.hostHandle)->loadProjectInternal(xml, true);
+
+        fOtherSlotInUse = carla_get_current_plugin_count(rack.hostHandle) != 0;
+        return fOtherSlotInUse;
+    }
+
+    bool switchSlot() override
+    {
+        if (! fOtherSlotInUse || fCrossfading.load(std::memory_order_acquire))
+            return false;
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        if (fSelectedLayer != 0)
+            return false;
+       #endif
+
+        startPluginSwap();
+        return true;
+    }
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+   /* --------------------------------------------------------------------------------------------------------
+    * Latency probe */
+
+    bool startLatencyProbe() override
+    {
+        if (fCarlaPluginDescriptor == nullptr || fCrossfading.load(std::memory_order_acquire))
+            return false;
+
+        if (fLatencyProbe.isThreadRunning())
+            return false;
+
+        const CarlaHostHandle handle = fRacks[fCurrentSlot].hostHandle;
+        IldaeilRack& rack(fLatencyProbe.rack);
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+
+        if (rack.pluginHandle == nullptr && ! initRack(rack))
+            return false;
+
+        // same as copying into the other A/B slot, the probe gets its own copy of the current plugins
+        water::MemoryOutputStream project;
+        carla_get_engine_from_handle(handle)->saveProjectInternal(project);
+
+        const water::String wproject(project.toString());
+        water::XmlDocument xml(wproject);
+
+        carla_remove_all_plugins(rack.hostHandle);
+        carla_get_engine_from_handle(rack.hostHandle)->loadProjectInternal(xml, true);
+
+        if (carla_get_current_plugin_count(rack.hostHandle) == 0)
+            return false;
+
+        fLatencyProbeValid.store(false, std::memory_order_release);
+        fLatencyProbeHandle = handle;
+        fLatencyProbeReported = getRackLatency(handle);
+
+        fLatencyProbe.bufferSize = getBufferSize();
+        fLatencyProbe.sampleRate = getSampleRate();
+
+        activateRack(rack);
+
+        if (fLatencyProbe.startThread())
+            return true;
+
+        deactivateRack(rack);
+        carla_remove_all_plugins(rack.hostHandle);
+        return false;
+    }
+
+    bool finishLatencyProbe() override
+    {
+        if (fLatencyProbe.isThreadRunning())
+            return false;
+
+        IldaeilRack& rack(fLatencyProbe.rack);
+
+        if (! rack.active)
+            return true;
+
+        const MutexLocker cml(sPluginInfoLoadMutex);
+
+        deactivateRack(rack);
+        carla_remove_all_plugins(rack.hostHandle);
+
+        fLatencyProbeMeasured = fLatencyProbe.measured;
+        fLatencyProbeValid.store(true, std::memory_order_release);
+
+        if (fLatencyProbeMeasured >= 0)
+            d_debug("Latency probe done, %u frames reported and %i measured",
+                    fLatencyProbeReported, fLatencyProbeMeasured);
+        else
+            d_debug("Latency probe done, no response from the plugins");
+
+        return true;
+    }
+
+    bool getLatencyProbeResult(IldaeilLatencyProbeResult& result) const override
+    {
+        if (! fLatencyProbeValid.load(std::memory_order_acquire))
+            return false;
+
+        result.reported = fLatencyProbeReported;
+        result.measured = fLatencyProbeMeasured;
+        return true;
+    }
+
+    bool getUseProbedLatency() const override
+    {
+        return fUseProbedLatency.load(std::memory_order_relaxed);
+    }
+
+    void setUseProbedLatency(const bool use) override
+    {
+        fUseProbedLatency.store(use, std::memory_order_relaxed);
+    }
+
+    // Stop a running probe, its rack needs to follow buffer size and sample rate changes.
+    void cancelLatencyProbe()
+    {
+        if (! fLatencyProbe.isThreadRunning())
+            return;
+
+        fLatencyProbe.stopThread(-1);
+        fLatencyProbe.measured = -1;
+    }
+   #endif
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+   /* --------------------------------------------------------------------------------------------------------
+    * Parallel layers */
+
+    uint getLayerCount() const override
+    {
+        return fLayerCount.load(std::memory_order_acquire);
+    }
+
+    uint getSelectedLayer() const override
+    {
+        return fSelectedLayer;
+    }
+
+    void selectLayer(const uint layer) override
+    {
+        const MutexLocker cml(fLayerMutex);
+
+        DISTRHO_SAFE_ASSERT_RETURN(layer < getLayerCount(),);
+
+        const IldaeilRack& rack(layer == 0 ? fRacks[fCurrentSlot] : fLayers[layer - 1].rack);
+
+        fSelectedLayer = layer;
+        fCarlaPluginHandle.store(rack.pluginHandle, std::memory_order_release);
+        fCarlaHostHandle.store(rack.hostHandle, std::memory_order_release);
+    }
+
+    bool addLayer() override
+    {
+        const MutexLocker cml(fLayerMutex);
+
+        const uint count = getLayerCount();
+
+        if (fCarlaPluginDescriptor == nullptr || count == kIldaeilMaxLayers)
+            return false;
+
+        IldaeilLayer& layer(fLayers[count - 1]);
+
+        if (layer.rack.pluginHandle == nullptr)
+        {
+            const MutexLocker cml(sPluginInfoLoadMutex);
+
+            if (! initRack(layer.rack))
+                return false;
+        }
+
+        if (fActive)
+            activateRack(layer.rack);
+
+        // without a worker the layer is rendered on the audio thread, after the main rack
+        if (! layer.startThread(true))
+            d_stderr("Failed to start worker thread for layer %u, rendering it serially", count + 1);
+
+        // not used by the audio thread until then, drop what is left from a previous use
+        layer.delay.clear();
+
+        if (count == 1)
+            fMainLayerDelay.clear();
+
+        // processed from the next audio block
+        fLayerCount.store(count + 1);
+        return true;
+    }
+
+    bool removeLastLayer() override
+    {
+        const MutexLocker cml(fLayerMutex);
+
+        const uint count = getLayerCount();
+
+        // the selected layer is in use by the UI, which selects another one first
+        if (count <= 1 || fSelectedLayer == count - 1)
+            return false;
+
+        // both sides use sequentially consistent ordering, so either the audio thread sees the new count
+        // or this thread sees it busy, after which it is safe to tear down the layer.
+        fLayerCount.store(count - 1);
+
+        while (fLayersBusy.load())
+            d_msleep(1);
+
+        IldaeilLayer& layer(fLayers[count - 2]);
+        layer.stop();
+
+        const MutexLocker cml2(sPluginInfoLoadMutex);
+
+        deactivateRack(layer.rack);
+        carla_remove_all_plugins(layer.rack.hostHandle);
+        return true;
+    }
+
+    IldaeilLayerSplit getLayerSplit(const uint layer) const override
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(layer < kIldaeilMaxLayers, IldaeilLayerSplit());
+
+        return unpackLayerSplit(fLayerSplits[layer].load(std::memory_order_relaxed));
+    }
+
+    void setLayerSplit(const uint layer, const IldaeilLayerSplit& split) override
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(layer < kIldaeilMaxLayers,);
+
+        fLayerSplits[layer].store(packLayerSplit(split), std::memory_order_relaxed);
+    }
+
+    // Remove extra layers at the end without any plugins, as left over when restoring a state with fewer layers.
+    // Stops at the layer selected in the UI, which stays empty until removed from there.
+    void removeUnusedLayers()
+    {
+        for (uint count = getLayerCount(); count > 1; --count)
+        {
+            if (carla_get_current_plugin_count(fLayers[count - 2].rack.hostHandle) != 0)
+                break;
+
+            if (! removeLastLayer())
+                break;
+        }
+    }
+   #endif
+
+    const NativeTimeInfo* hostGetTimeInfo(const IldaeilRack* const rack) const noexcept
+    {
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        if (rack == &fLatencyProbe.rack)
+            return &fLatencyProbe.timeInfo;
+       #endif
+
+        return &fCarlaTimeInfo;
+    }
+
+    // Called once per block by the audio thread, before processing any rack.
+    void updateTimeInfo() noexcept
+    {
+        const TimePosition& timePos(getTimePosition());
+
+        fCarlaTimeInfo.playing = timePos.playing;
+        fCarlaTimeInfo.frame = timePos.frame;
+        fCarlaTimeInfo.bbt.valid = timePos.bbt.valid;
+        fCarlaTimeInfo.bbt.bar = timePos.bbt.bar;
+        fCarlaTimeInfo.bbt.beat = timePos.bbt.beat;
+        fCarlaTimeInfo.bbt.tick = timePos.bbt.tick;
+        fCarlaTimeInfo.bbt.barStartTick = timePos.bbt.barStartTick;
+        fCarlaTimeInfo.bbt.beatsPerBar = timePos.bbt.beatsPerBar;
+        fCarlaTimeInfo.bbt.beatType = timePos.bbt.beatType;
+        fCarlaTimeInfo.bbt.ticksPerBeat = timePos.bbt.ticksPerBeat;
+        fCarlaTimeInfo.bbt.beatsPerMinute = timePos.bbt.beatsPerMinute;
+    }
+
+#if DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
+    bool hostWriteMidiEvent(const NativeMidiEvent* const event)
+    {
+        MidiEvent midiEvent;
+        midiEvent.frame = event->time;
+        midiEvent.size = event->size;
+        midiEvent.dataExt = nullptr;
+
+        uint32_t i = 0;
+        for (; i < event->size; ++i)
+            midiEvent.data[i] = event->data[i];
+        for (; i < MidiEvent::kDataSize; ++i)
+            midiEvent.data[i] = 0;
+
+        return writeMidiEvent(midiEvent);
+    }
+#endif
+
+    intptr_t hostDispatcher(const IldaeilRack* const rack, const NativeHostDispatcherOpcode opcode,
+                            const int32_t index, const intptr_t value, void* const ptr, const float opt)
+    {
+        switch (opcode)
+        {
+        // cannnot be supported
+        case NATIVE_HOST_OPCODE_HOST_IDLE:
+            break;
+        // other stuff
+        case NATIVE_HOST_OPCODE_NULL:
+        case NATIVE_HOST_OPCODE_UPDATE_PARAMETER:
+        case NATIVE_HOST_OPCODE_UPDATE_MIDI_PROGRAM:
+        case NATIVE_HOST_OPCODE_RELOAD_PARAMETERS:
+        case NATIVE_HOST_OPCODE_RELOAD_MIDI_PROGRAMS:
+        case NATIVE_HOST_OPCODE_RELOAD_ALL:
+        case NATIVE_HOST_OPCODE_UI_UNAVAILABLE:
+        case NATIVE_HOST_OPCODE_INTERNAL_PLUGIN:
+        case NATIVE_HOST_OPCODE_QUEUE_INLINE_DISPLAY:
+        case NATIVE_HOST_OPCODE_UI_TOUCH_PARAMETER:
+        case NATIVE_HOST_OPCODE_REQUEST_IDLE:
+        case NATIVE_HOST_OPCODE_GET_FILE_PATH:
+        case NATIVE_HOST_OPCODE_PREVIEW_BUFFER_DATA:
+            // TESTING
+            d_stdout("dispatcher %i:%s, %i, %li, %p, %f",
+                      opcode, NativeHostDispatcherOpcode2Str(opcode), index, value, ptr, opt);
+            break;
+        case NATIVE_HOST_OPCODE_UI_RESIZE:
+            if (isUIRack(rack))
+                ildaeilResizeUI(fUI, index, value);
+            break;
+        }
+
+        return 0;
+    }
+
+protected:
+   /* --------------------------------------------------------------------------------------------------------
+    * Information */
+
+    const char* getLabel() const override
+    {
+#if ILDAEIL_STANDALONE
+        return "Ildaeil";
+#elif DISTRHO_PLUGIN_IS_SYNTH
+        return "IldaeilSynth";
+#elif DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
+        return "IldaeilMIDI";
+#else
+        return "IldaeilFX";
+#endif
+    }
+
+    const char* getDescription() const override
+    {
+        return "Ildaeil is a mini-plugin host working as a plugin, allowing one-to-one plugin format reusage.";
     }
 
     const char* getMaker() const override
@@ -541,126 +1483,739 @@ protected:
         return "DISTRHO";
     }
 
-    const char* getHomePage() const override
+    const char* getHomePage() const override
+    {
+        return "https://github.com/DISTRHO/Ildaeil";
+    }
+
+    const char* getLicense() const override
+    {
+        return "GPLv2+";
+    }
+
+    uint32_t getVersion() const override
+    {
+        return d_version(1, 3, 0);
+    }
+
+    int64_t getUniqueId() const override
+    {
+       #if ILDAEIL_STANDALONE
+        return d_cconst('d', 'I', 'l', 'd');
+       #elif DISTRHO_PLUGIN_IS_SYNTH
+        return d_cconst('d', 'I', 'l', 'S');
+       #elif DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
+        return d_cconst('d', 'I', 'l', 'M');
+       #else
+        return d_cconst('d', 'I', 'l', 'F');
+       #endif
+    }
+
+   /* --------------------------------------------------------------------------------------------------------
+    * Init */
+
+    void initAudioPort(bool input, uint32_t index, AudioPort& port) override
+    {
+        port.groupId = kPortGroupStereo;
+        Plugin::initAudioPort(input, index, port);
+    }
+
+    void initParameter(const uint32_t index, Parameter& parameter) override
+    {
+        switch (index)
+        {
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        case kIldaeilParameterDryWet:
+            parameter.hints = kParameterIsAutomatable;
+            parameter.name = "Dry/Wet";
+            parameter.symbol = "drywet";
+            parameter.unit = "%";
+            parameter.ranges.def = 100.f;
+            parameter.ranges.min = 0.f;
+            parameter.ranges.max = 100.f;
+            break;
+       #endif
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        case kIldaeilParameterBypass:
+            parameter.initDesignation(kParameterDesignationBypass);
+            break;
+        case kIldaeilParameterFixedLatency:
+            // latency reported to the host regardless of the hosted plugins, as long as theirs fits in it
+            parameter.hints = kParameterIsInteger;
+            parameter.name = "Fixed Latency";
+            parameter.symbol = "fixed_latency";
+            parameter.unit = "ms";
+            parameter.ranges.def = 0.f;
+            parameter.ranges.min = 0.f;
+            parameter.ranges.max = kMaxFixedLatency;
+            break;
+       #endif
+        }
+    }
+
+    void initState(const uint32_t index, State& state) override
+    {
+        switch (index)
+        {
+        case 0:
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "project";
+            state.defaultValue = ""
+            "<?xml version='1.0' encoding='UTF-8'?>\n"
+            "<!DOCTYPE CARLA-PROJECT>\n"
+            "<CARLA-PROJECT VERSION='" CARLA_VERSION_STRMIN "'>\n"
+            "</CARLA-PROJECT>\n";
+            break;
+        case 1:
+            // project of the A/B slot not in use, empty if there is none
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "inactive-slot";
+            state.defaultValue = "";
+            break;
+        case 2:
+            // crossfade time in ms and whether to keep the plugin editor open while showing the generic one
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "options";
+            state.defaultValue = "";
+            break;
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        case 3:
+            // low key, high key, low velocity and high velocity of each layer
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "layer-splits";
+            state.defaultValue = "";
+            break;
+        default:
+            // project of an extra layer, empty if there is none
+            state.hints = kStateIsOnlyForDSP;
+            state.key = "layer-" + String(index - 2);
+            state.defaultValue = "";
+            break;
+       #endif
+        }
+    }
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // Returns the layer index of a "layer-N" state key (N counting from 1 as in the UI), or 0 if not one.
+    static uint getLayerFromStateKey(const char* const key) noexcept
+    {
+        if (std::strncmp(key, "layer-", 6) != 0)
+            return 0;
+
+        const int layer = std::atoi(key + 6) - 1;
+        return layer > 0 && layer < static_cast<int>(kIldaeilMaxLayers) ? layer : 0;
+    }
+   #endif
+
+   /* --------------------------------------------------------------------------------------------------------
+    * Internal data */
+
+    float getParameterValue(const uint32_t index) const override
+    {
+        switch (index)
+        {
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        case kIldaeilParameterDryWet:
+            return fDryWet * 100.f;
+       #endif
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        case kIldaeilParameterBypass:
+            return fBypassed ? 1.f : 0.f;
+        case kIldaeilParameterFixedLatency:
+            return fFixedLatency;
+       #endif
+        }
+
+        return 0.f;
+    }
+
+    void setParameterValue(const uint32_t index, const float value) override
+    {
+        switch (index)
+        {
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        case kIldaeilParameterDryWet:
+            fDryWet = std::max(0.f, std::min(1.f, value / 100.f));
+            break;
+       #endif
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        case kIldaeilParameterBypass:
+            fBypassed = value > 0.5f;
+            break;
+        case kIldaeilParameterFixedLatency:
+            fFixedLatency = static_cast<uint>(std::max(0.f, std::min<float>(kMaxFixedLatency, value + 0.5f)));
+            break;
+       #endif
+        }
+    }
+
+    String getState(const char* const key) const override
+    {
+        if (std::strcmp(key, "project") == 0)
+        {
+            CarlaEngine* const engine = carla_get_engine_from_handle(fRacks[fCurrentSlot].hostHandle);
+
+            fLastProjectState.reset();
+            engine->saveProjectInternal(fLastProjectState);
+            return String(static_cast<char*>(fLastProjectState.getDataAndRelease()), false);
+        }
+
+        if (std::strcmp(key, "inactive-slot") == 0)
+        {
+            // not loaded yet, save it as restored
+            if (fOtherSlotStatePending)
+                return fPendingOtherSlotState;
+
+            if (! fOtherSlotInUse)
+                return String();
+
+            CarlaEngine* const engine = carla_get_engine_from_handle(fRacks[1 - getCurrentSlot()].hostHandle);
+
+            fLastProjectState.reset();
+            engine->saveProjectInternal(fLastProjectState);
+            return String(static_cast<char*>(fLastProjectState.getDataAndRelease()), false);
+        }
+
+        if (std::strcmp(key, "options") == 0)
+        {
+            char buf[24];
+            std::snprintf(buf, sizeof(buf), "%u %u", getCrossfadeTime(), getKeepEmbedUI() ? 1 : 0);
+            return String(buf);
+        }
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        if (std::strcmp(key, "layer-splits") == 0)
+        {
+            String splits;
+
+            for (uint i = 0; i < kIldaeilMaxLayers; ++i)
+            {
+                const IldaeilLayerSplit split(getLayerSplit(i));
+
+                char buf[24];
+                std::snprintf(buf, sizeof(buf), i == 0 ? "%u %u %u %u" : " %u %u %u %u",
+                              split.lowKey, split.highKey, split.lowVelocity, split.highVelocity);
+                splits += buf;
+            }
+
+            return splits;
+        }
+
+        if (const uint layer = getLayerFromStateKey(key))
+        {
+            if (layer >= getLayerCount())
+                return String();
+
+            CarlaEngine* const engine = carla_get_engine_from_handle(fLayers[layer - 1].rack.hostHandle);
+
+            fLastProjectState.reset();
+            engine->saveProjectInternal(fLastProjectState);
+            return String(static_cast<char*>(fLastProjectState.getDataAndRelease()), false);
+        }
+       #endif
+
+        return String();
+    }
+
+    void setState(const char* const key, const char* const value) override
+    {
+        if (std::strcmp(key, "project") == 0)
+        {
+            CarlaEngine* const engine = carla_get_engine_from_handle(fRacks[fCurrentSlot].hostHandle);
+
+            const water::String wvalue(value);
+            water::XmlDocument xml(wvalue);
+
+            {
+                const MutexLocker cml(sPluginInfoLoadMutex);
+                engine->loadProjectInternal(xml, true);
+            }
+
+            fPluginGenericUICache = nullptr;
+
+            if (fUI != nullptr)
+                ildaeilProjectLoadedFromDSP(fUI);
+            else
+                clearPluginChainDetails(0);
+        }
+        else if (std::strcmp(key, "inactive-slot") == 0)
+        {
+            if (fCarlaPluginDescriptor == nullptr)
+                return;
+
+            const MutexLocker cml(sPluginInfoLoadMutex);
+
+            fPendingOtherSlotState = value;
+            fOtherSlotStatePending = true;
+
+            if (fUI == nullptr)
+                fOtherSlotDetails = PluginSlot();
+
+            // the rack not in use is still being faded out, finishPluginSwap() or deactivate() load it instead.
+            // checked with the mutex held, so a swap finishing in the meantime does not miss it.
+            if (fCrossfading.load(std::memory_order_acquire))
+                return;
+
+            loadPendingOtherSlotState();
+        }
+        else if (std::strcmp(key, "options") == 0)
+        {
+            uint crossfadeTime, keepEmbedUI;
+
+            // older or missing state, keep the defaults
+            if (std::sscanf(value, "%u %u", &crossfadeTime, &keepEmbedUI) != 2)
+                return;
+
+            setCrossfadeTime(crossfadeTime);
+            setKeepEmbedUI(keepEmbedUI != 0);
+        }
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        else if (std::strcmp(key, "layer-splits") == 0)
+        {
+            const char* s = value;
+
+            for (uint i = 0; i < kIldaeilMaxLayers; ++i)
+            {
+                uint values[4];
+                int read = 0;
+
+                if (std::sscanf(s, "%u %u %u %u%n", &values[0], &values[1], &values[2], &values[3], &read) != 4)
+                {
+                    // older or missing state, every layer gets all notes
+                    setLayerSplit(i, IldaeilLayerSplit());
+                    continue;
+                }
+
+                s += read;
+
+                IldaeilLayerSplit split;
+                split.lowKey = std::min(values[0], 127u);
+                split.highKey = std::min(values[1], 127u);
+                split.lowVelocity = std::min(values[2], 127u);
+                split.highVelocity = std::min(values[3], 127u);
+                setLayerSplit(i, split);
+            }
+        }
+        else if (const uint layer = getLayerFromStateKey(key))
+        {
+            if (fCarlaPluginDescriptor == nullptr)
+                return;
+
+            if (value[0] != '\0')
+            {
+                while (getLayerCount() <= layer)
+                {
+                    if (! addLayer())
+                        return;
+                }
+
+                const CarlaHostHandle handle = fLayers[layer - 1].rack.hostHandle;
+
+                const water::String wvalue(value);
+                water::XmlDocument xml(wvalue);
+
+                const MutexLocker cml(sPluginInfoLoadMutex);
+
+                carla_remove_all_plugins(handle);
+                carla_get_engine_from_handle(handle)->loadProjectInternal(xml, true);
+            }
+            else if (layer < getLayerCount())
+            {
+                const MutexLocker cml(sPluginInfoLoadMutex);
+                carla_remove_all_plugins(fLayers[layer - 1].rack.hostHandle);
+            }
+
+            removeUnusedLayers();
+
+            if (fUI == nullptr)
+                clearPluginChainDetails(layer);
+            else if (layer == fSelectedLayer)
+                ildaeilProjectLoadedFromDSP(fUI);
+        }
+       #endif
+    }
+
+    // Load the A/B slot restored by the host into the rack not in use, sPluginInfoLoadMutex must be locked.
+    void loadPendingOtherSlotState()
     {
-        return "https://github.com/DISTRHO/Ildaeil";
+        fOtherSlotStatePending = false;
+
+        const String value(fPendingOtherSlotState);
+        fPendingOtherSlotState.clear();
+
+        IldaeilRack& rack(fRacks[1 - getCurrentSlot()]);
+
+        if (rack.hostHandle != nullptr)
+            carla_remove_all_plugins(rack.hostHandle);
+
+        fOtherSlotInUse = false;
+
+        if (value.isEmpty() || (rack.pluginHandle == nullptr && ! initRack(rack)))
+            return;
+
+        const water::String wvalue(value.buffer());
+        water::XmlDocument xml(wvalue);
+
+        carla_get_engine_from_handle(rack.hostHandle)->loadProjectInternal(xml, true);
+
+        fOtherSlotInUse = carla_get_current_plugin_count(rack.hostHandle) != 0;
     }
 
-    const char* getLicense() const override
+    // Forget what the UI knew about the plugins of a layer after a project got loaded into it while the UI is closed.
+    void clearPluginChainDetails(const uint layer)
     {
-        return "GPLv2+";
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        if (layer != fSelectedLayer)
+        {
+            fLayerChainDetails[layer] = PluginChainDetails();
+            return;
+        }
+       #else
+        // no layers, only the main rack
+        (void)layer;
+       #endif
+
+        fPluginChainDetails = PluginChainDetails();
     }
 
-    uint32_t getVersion() const override
+   /* --------------------------------------------------------------------------------------------------------
+    * Process */
+
+    static uint32_t getRackLatency(const CarlaHostHandle handle)
     {
-        return d_version(1, 3, 0);
+        uint32_t latency = 0;
+
+        // plugins in a chain run in series
+        for (uint32_t i=0; i < carla_get_current_plugin_count(handle); ++i)
+            latency += carla_get_plugin_latency(handle, i);
+
+        return latency;
     }
 
-    int64_t getUniqueId() const override
+    // Update fPluginLatency and return the latency that should be reported for it.
+    uint32_t updatePluginLatency()
     {
-       #if ILDAEIL_STANDALONE
-        return d_cconst('d', 'I', 'l', 'd');
-       #elif DISTRHO_PLUGIN_IS_SYNTH
-        return d_cconst('d', 'I', 'l', 'S');
-       #elif DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
-        return d_cconst('d', 'I', 'l', 'M');
+        const CarlaHostHandle handle = fRacks[fFrontRack.load(std::memory_order_acquire)].hostHandle;
+
+        if (handle == nullptr)
+            return fLastLatencyValue;
+
+        uint32_t latency = getRackLatency(handle);
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        // same plugins as when probed, still reporting the same latency
+        if (fUseProbedLatency.load(std::memory_order_relaxed) && fLatencyProbeValid.load(std::memory_order_acquire)
+            && fLatencyProbeHandle == handle && fLatencyProbeReported == latency && fLatencyProbeMeasured >= 0)
+            latency = static_cast<uint32_t>(fLatencyProbeMeasured);
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        // layers are padded up to the largest one before mixing, see alignLayerOutput()
+        fMainLayerLatency = latency;
+
+        for (uint i = 1; i < getLayerCount(); ++i)
+        {
+            IldaeilLayer& layer(fLayers[i - 1]);
+            layer.latency = getRackLatency(layer.rack.hostHandle);
+            latency = std::max(latency, layer.latency);
+        }
+       #endif
+
+        fPluginLatency = latency;
+
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        const uint32_t fixedLatency = static_cast<uint32_t>(fFixedLatency * getSampleRate() / 1000.0);
+        return std::max(latency, fixedLatency);
        #else
-        return d_cconst('d', 'I', 'l', 'F');
+        return latency;
        #endif
     }
 
-   /* --------------------------------------------------------------------------------------------------------
-    * Init */
+    void reportLatency(const uint32_t latency)
+    {
+        fLastLatencyValue = latency;
+        fPendingLatency = latency;
+        fPendingLatencyFrames = 0;
+        setLatency(latency);
+    }
 
-    void initAudioPort(bool input, uint32_t index, AudioPort& port) override
+    // Called after processing each block, reports a new latency once it has been stable long enough.
+    void checkLatencyChanged(const uint32_t frames)
     {
-        port.groupId = kPortGroupStereo;
-        Plugin::initAudioPort(input, index, port);
+        const uint32_t latency = updatePluginLatency();
+
+        if (latency == fLastLatencyValue)
+        {
+            fPendingLatencyFrames = 0;
+            return;
+        }
+
+        if (latency != fPendingLatency)
+        {
+            fPendingLatency = latency;
+            fPendingLatencyFrames = 0;
+        }
+
+        fPendingLatencyFrames += frames;
+
+        if (fPendingLatencyFrames >= kLatencyDebounceTime * getSampleRate() / 1000.0)
+            reportLatency(latency);
     }
 
-    void initState(const uint32_t index, State& state) override
+    // Called when audio starts or stops, no need to wait for anything then.
+    void checkLatencyChangedNow()
     {
-        DISTRHO_SAFE_ASSERT_RETURN(index == 0,);
+        const uint32_t latency = updatePluginLatency();
 
-        state.hints = kStateIsOnlyForDSP;
-        state.key = "project";
-        state.defaultValue = ""
-        "<?xml version='1.0' encoding='UTF-8'?>\n"
-        "<!DOCTYPE CARLA-PROJECT>\n"
-        "<CARLA-PROJECT VERSION='" CARLA_VERSION_STRMIN "'>\n"
-        "</CARLA-PROJECT>\n";
+        if (latency != fLastLatencyValue)
+            reportLatency(latency);
     }
 
-   /* --------------------------------------------------------------------------------------------------------
-    * Internal data */
+    void updateProcessLoad(const uint64_t timeStart, const uint32_t frames)
+    {
+        const double timeTaken = static_cast<double>(d_gettime_us() - timeStart);
+        const double timeAvailable = frames * 1000000.0 / getSampleRate();
+        const float load = static_cast<float>(timeTaken / timeAvailable);
+        const float lastLoad = fProcessLoad.load(std::memory_order_relaxed);
 
-    String getState(const char* const key) const override
+        fProcessLoad.store(load > lastLoad ? load : lastLoad * 0.95f + load * 0.05f, std::memory_order_relaxed);
+    }
+
+    void activate() override
     {
-        if (std::strcmp(key, "project") == 0)
+        fActive = true;
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fDryDelay.clear();
+       #endif
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        fWetDelay.clear();
+        // no ramp when starting
+        fWetGain = getWetGainTarget();
+       #endif
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        fMainLayerDelay.clear();
+
+        for (IldaeilLayer& layer : fLayers)
+            layer.delay.clear();
+       #endif
+
+        activateRack(fRacks[fFrontRack.load(std::memory_order_acquire)]);
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        for (uint i = 1; i < getLayerCount(); ++i)
+            activateRack(fLayers[i - 1].rack);
+       #endif
+
+        checkLatencyChangedNow();
+    }
+
+    void deactivate() override
+    {
+        fActive = false;
+        fProcessLoad.store(0.f, std::memory_order_relaxed);
+
+        // audio stopped mid-crossfade, jump to its end
+        if (fCrossfading.load(std::memory_order_acquire))
         {
-            CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
+            deactivateRack(fRacks[1 - fCrossfadeTarget]);
+            fFrontRack.store(fCrossfadeTarget, std::memory_order_release);
 
-            fLastProjectState.reset();
-            engine->saveProjectInternal(fLastProjectState);
-            return String(static_cast<char*>(fLastProjectState.getDataAndRelease()), false);
+            const MutexLocker cml(sPluginInfoLoadMutex);
+            fCrossfading.store(false, std::memory_order_release);
+
+            if (fOtherSlotStatePending)
+                loadPendingOtherSlotState();
         }
 
-        return String();
+        checkLatencyChangedNow();
+
+        deactivateRack(fRacks[fFrontRack.load(std::memory_order_acquire)]);
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        for (uint i = 1; i < getLayerCount(); ++i)
+            deactivateRack(fLayers[i - 1].rack);
+       #endif
     }
 
-    void setState(const char* const key, const char* const value) override
+   #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+    float getWetGainTarget() const noexcept
     {
-        if (std::strcmp(key, "project") == 0)
-        {
-            CarlaEngine* const engine = carla_get_engine_from_handle(fCarlaHostHandle);
+        if (fBypassed)
+            return 0.f;
 
-            const water::String wvalue(value);
-            water::XmlDocument xml(wvalue);
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        return fDryWet;
+       #else
+        return 1.f;
+       #endif
+    }
 
-            {
-                const MutexLocker cml(sPluginInfoLoadMutex);
-                engine->loadProjectInternal(xml, true);
-            }
+    // Delay the output of the hosted plugins by the difference between the reported latency and their own.
+    // Always written so the padding can start right away when the reported latency goes up.
+    void padWetOutput(float** const outputs, const uint32_t frames)
+    {
+        fWetDelay.write(outputs, frames);
 
-            if (fUI != nullptr)
-                ildaeilProjectLoadedFromDSP(fUI);
-        }
+        if (fLastLatencyValue > fPluginLatency)
+            fWetDelay.read(outputs, frames, std::min(fLastLatencyValue - fPluginLatency, fMaxDelay));
     }
 
-   /* --------------------------------------------------------------------------------------------------------
-    * Process */
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // The wet signal is padded up to the reported latency, but a higher plugin latency is not reported right away.
+    // until it is, the dry signal follows the plugin latency so both stay aligned.
+    uint32_t getDryDelay() const noexcept
+    {
+        return std::min(std::max(fLastLatencyValue, fPluginLatency), fMaxDelay);
+    }
+   #endif
 
-    void checkLatencyChanged()
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // Delay the output of a layer by the difference between its latency and the largest layer latency,
+    // so all layers line up when mixed. Always written so the padding can start right away when latencies change.
+    void alignLayerOutput(IldaeilDelayLine& delay, float** const buffers, const uint32_t frames, const uint32_t latency)
     {
-        if (fCarlaHostHandle == nullptr)
+        delay.write(buffers, frames);
+
+        if (fPluginLatency > latency)
+            delay.read(buffers, frames, std::min(fPluginLatency - latency, fMaxDelay));
+    }
+   #endif
+
+    // Ramp the output of the hosted plugins towards its target gain, mixing in the delayed dry signal if there is one.
+    void applyWetGain(float** const outputs, const uint32_t frames)
+    {
+        const float target = getWetGainTarget();
+        const float start = fWetGain;
+        const float maxChange = static_cast<float>(frames * 1000.0 / (kBypassRampTime * getSampleRate()));
+        const float end = target > start ? std::min(target, start + maxChange) : std::max(target, start - maxChange);
+
+        fWetGain = end;
+
+        if (d_isEqual(start, 1.f) && d_isEqual(end, 1.f))
             return;
 
-        uint32_t latency = 0;
+        // kept as simple loops without branches so they get vectorized
+        const float step = (end - start) / static_cast<float>(frames);
 
-        for (uint32_t i=0; i < carla_get_current_plugin_count(fCarlaHostHandle); ++i)
-            latency += carla_get_plugin_latency(fCarlaHostHandle, i);
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        const uint32_t readPos = fDryDelay.getReadPos(frames, getDryDelay());
+       #endif
 
-        if (fLastLatencyValue != latency)
+        for (uint c = 0; c < 2; ++c)
         {
-            fLastLatencyValue = latency;
-            setLatency(latency);
+            float* const out = outputs[c];
+
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            const float* const dry = fDryDelay.buffer + fDryDelay.size * c;
+            const uint32_t mask = fDryDelay.size - 1;
+
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                const float gain = start + static_cast<float>(i + 1) * step;
+                const float in = dry[(readPos + i) & mask];
+                out[i] = in + (out[i] - in) * gain;
+            }
+           #else
+            for (uint32_t i = 0; i < frames; ++i)
+                out[i] *= start + static_cast<float>(i + 1) * step;
+           #endif
         }
     }
 
-    void activate() override
+    // Fully bypassed, the hosted plugins are not processed at all.
+    // The dry signal keeps the same delay, so the reported latency does not change.
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    void processBypassed(const float** const inputs, float** const outputs, const uint32_t frames)
+   #else
+    void processBypassed(const float**, float** const outputs, const uint32_t frames)
+   #endif
     {
-        if (fCarlaPluginHandle != nullptr)
-            fCarlaPluginDescriptor->activate(fCarlaPluginHandle);
+        // nothing to fade, finish a pending swap right away
+        if (fCrossfading.load(std::memory_order_acquire))
+        {
+            fFrontRack.store(fCrossfadeTarget, std::memory_order_release);
+            fCrossfading.store(false, std::memory_order_release);
+        }
+
+        fProcessingSkipped = true;
 
-        checkLatencyChanged();
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fDryDelay.write(inputs, frames);
+        fDryDelay.read(outputs, frames, getDryDelay());
+       #else
+        std::memset(outputs[0], 0, sizeof(float)*frames);
+        std::memset(outputs[1], 0, sizeof(float)*frames);
+       #endif
     }
+   #endif
 
-    void deactivate() override
+   #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
+    // "All Notes Off" on every channel, returns the number of events written
+    static uint32_t writeAllNotesOffEvents(NativeMidiEvent* const midiEvents)
+    {
+        for (uint8_t channel = 0; channel < 16; ++channel)
+        {
+            NativeMidiEvent& midiEvent(midiEvents[channel]);
+            midiEvent.time = 0;
+            midiEvent.port = 0;
+            midiEvent.size = 3;
+            midiEvent.data[0] = 0xB0 | channel;
+            midiEvent.data[1] = 0x7B;
+            midiEvent.data[2] = 0;
+        }
+
+        return 16;
+    }
+   #endif
+
+    void processCrossfade(const float** const inputs, float** const outputs, const uint32_t frames,
+                          const NativeMidiEvent* const midiEvents, const uint32_t midiEventCount)
     {
-        checkLatencyChanged();
+        const IldaeilRack& oldRack(fRacks[1 - fCrossfadeTarget]);
+        const IldaeilRack& newRack(fRacks[fCrossfadeTarget]);
+
+        float* newInputs[2] = {
+            fCrossfadeBuffer,
+            fCrossfadeBuffer + fCrossfadeBufferSize,
+        };
+        float* newOutputs[2] = {
+            fCrossfadeBuffer + fCrossfadeBufferSize * 2,
+            fCrossfadeBuffer + fCrossfadeBufferSize * 3,
+        };
+
+        // inputs and outputs might be the same buffers, keep a copy of the inputs for the new rack
+        std::memcpy(newInputs[0], inputs[0], sizeof(float)*frames);
+        std::memcpy(newInputs[1], inputs[1], sizeof(float)*frames);
+
+        fCarlaPluginDescriptor->process(oldRack.pluginHandle, (float**)inputs, outputs, frames,
+                                        midiEvents, midiEventCount);
+        fCarlaPluginDescriptor->process(newRack.pluginHandle, newInputs, newOutputs, frames,
+                                        midiEvents, midiEventCount);
+
+        // linear fade, kept as a simple loop without branches so it gets vectorized
+        const float step = fCrossfadeLength != 0 ? 1.f / static_cast<float>(fCrossfadeLength) : 1.f;
+        const float start = static_cast<float>(fCrossfadeFrame + 1) * step;
+
+        for (uint c = 0; c < 2; ++c)
+        {
+            float* const out = outputs[c];
+            const float* const in = newOutputs[c];
+
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                const float gain = std::min(1.f, start + static_cast<float>(i) * step);
+                out[i] += (in[i] - out[i]) * gain;
+            }
+        }
+
+        fCrossfadeFrame += frames;
 
-        if (fCarlaPluginHandle != nullptr)
-            fCarlaPluginDescriptor->deactivate(fCarlaPluginHandle);
+        if (fCrossfadeFrame >= fCrossfadeLength)
+        {
+            fFrontRack.store(fCrossfadeTarget, std::memory_order_release);
+            fCrossfading.store(false, std::memory_order_release);
+        }
     }
 
 #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
@@ -670,10 +2225,34 @@ protected:
     void run(const float** inputs, float** outputs, uint32_t frames) override
 #endif
     {
-        if (fCarlaPluginHandle != nullptr)
+        const NativePluginHandle pluginHandle = fRacks[fFrontRack.load(std::memory_order_acquire)].pluginHandle;
+
+        if (pluginHandle != nullptr)
         {
+            const uint64_t timeStart = d_gettime_us();
+            const ScopedParameterQueue spq(kIldaeilParameterQueueAudio);
+
+            updateTimeInfo();
+
+           #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+            if (fBypassed && fWetGain == 0.f)
+            {
+                processBypassed(inputs, outputs, frames);
+                updateProcessLoad(timeStart, frames);
+                return;
+            }
+           #endif
+
            #if DISTRHO_PLUGIN_WANT_MIDI_INPUT
             uint32_t midiEventCount = 0;
+
+            // notes playing before the bypass never got their note-offs
+            if (fProcessingSkipped)
+            {
+                fProcessingSkipped = false;
+                midiEventCount = writeAllNotesOffEvents(fMidiEvents);
+            }
+
             for (uint32_t i=0; i < dpfMidiEventCount; ++i)
             {
                 const MidiEvent& dpfMidiEvent(dpfMidiEvents[i]);
@@ -702,10 +2281,77 @@ protected:
             outputs = fDummyBuffers;
            #endif
 
-            fCarlaPluginDescriptor->process(fCarlaPluginHandle, (float**)inputs, outputs, frames,
-                                            fMidiEvents, midiEventCount);
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            // before processing, inputs and outputs might be the same buffers
+            fDryDelay.write(inputs, frames);
+           #endif
+
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            // set before reading the layer count, see removeLastLayer()
+            fLayersBusy.store(true);
+            const uint layerCount = fLayerCount.load();
+
+            // fork, extra layers render on their worker threads while this one does the main rack
+            for (uint i = 1; i < layerCount; ++i)
+            {
+                IldaeilLayer& layer(fLayers[i - 1]);
+                layer.frames = frames;
+                layer.midiEventCount = copyMidiEventsForLayer(fMidiEvents, midiEventCount, layer.midiEvents,
+                                                              fLayerSplits[i].load(std::memory_order_relaxed));
+
+                if (layer.isThreadRunning())
+                    layer.processStart.post();
+            }
+
+            midiEventCount = copyMidiEventsForLayer(fMidiEvents, midiEventCount, fMidiEvents,
+                                                    fLayerSplits[0].load(std::memory_order_relaxed));
+           #endif
+
+            if (fCrossfading.load(std::memory_order_acquire))
+                processCrossfade(inputs, outputs, frames, fMidiEvents, midiEventCount);
+            else
+                fCarlaPluginDescriptor->process(pluginHandle, (float**)inputs, outputs, frames,
+                                                fMidiEvents, midiEventCount);
+
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            if (layerCount > 1)
+                alignLayerOutput(fMainLayerDelay, outputs, frames, fMainLayerLatency);
+
+            // join, then mix each layer in with a simple loop so it gets vectorized
+            for (uint i = 1; i < layerCount; ++i)
+            {
+                IldaeilLayer& layer(fLayers[i - 1]);
+
+                if (layer.isThreadRunning())
+                    layer.processDone.wait();
+                else
+                    layer.process();
+
+                alignLayerOutput(layer.delay, layer.outputs, frames, layer.latency);
+
+                for (uint c = 0; c < 2; ++c)
+                {
+                    float* const out = outputs[c];
+                    const float* const in = layer.outputs[c];
+
+                    for (uint32_t j = 0; j < frames; ++j)
+                        out[j] += in[j];
+                }
+            }
+           #endif
+
+            checkLatencyChanged(frames);
+
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            fLayersBusy.store(false);
+           #endif
+
+           #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+            padWetOutput(outputs, frames);
+            applyWetGain(outputs, frames);
+           #endif
 
-            checkLatencyChanged();
+            updateProcessLoad(timeStart, frames);
         }
         else
         {
@@ -714,8 +2360,29 @@ protected:
         }
     }
 
+    // Size the delay lines for the longest latency compensated, not realtime safe.
+    void resizeDelayLines(const uint32_t bufferSize, const double sampleRate)
+    {
+        fMaxDelay = static_cast<uint32_t>(sampleRate * kMaxCompensatedLatency / 1000.0);
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        fDryDelay.resize(fMaxDelay, bufferSize);
+       #endif
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        fWetDelay.resize(fMaxDelay, bufferSize);
+       #endif
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        fMainLayerDelay.resize(fMaxDelay, bufferSize);
+
+        for (IldaeilLayer& layer : fLayers)
+            layer.delay.resize(fMaxDelay, bufferSize);
+       #endif
+    }
+
     void bufferSizeChanged(const uint32_t newBufferSize) override
     {
+        resizeDelayLines(newBufferSize, getSampleRate());
+
        #if DISTRHO_PLUGIN_NUM_INPUTS == 0 || DISTRHO_PLUGIN_NUM_OUTPUTS == 0
         delete[] fDummyBuffer;
         fDummyBuffer = new float[newBufferSize];
@@ -724,16 +2391,73 @@ protected:
         std::memset(fDummyBuffer, 0, sizeof(float)*newBufferSize);
        #endif
 
-        if (fCarlaPluginHandle != nullptr)
-            fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+        // 2 input copies plus 2 outputs for the new rack
+        delete[] fCrossfadeBuffer;
+        fCrossfadeBuffer = new float[newBufferSize * 4];
+        fCrossfadeBufferSize = newBufferSize;
+
+        for (IldaeilRack& rack : fRacks)
+        {
+            if (rack.pluginHandle != nullptr)
+                fCarlaPluginDescriptor->dispatcher(rack.pluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+                                                   0, newBufferSize, nullptr, 0.0f);
+        }
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        cancelLatencyProbe();
+
+        if (fLatencyProbe.rack.pluginHandle != nullptr)
+            fCarlaPluginDescriptor->dispatcher(fLatencyProbe.rack.pluginHandle,
+                                               NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
                                                0, newBufferSize, nullptr, 0.0f);
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        // 2 outputs per extra layer
+        delete[] fLayerBuffer;
+        fLayerBuffer = new float[newBufferSize * 2 * (kIldaeilMaxLayers - 1)];
+
+        for (uint i = 0; i < kIldaeilMaxLayers - 1; ++i)
+        {
+            IldaeilLayer& layer(fLayers[i]);
+            layer.outputs[0] = fLayerBuffer + newBufferSize * i * 2;
+            layer.outputs[1] = fLayerBuffer + newBufferSize * (i * 2 + 1);
+
+            if (layer.rack.pluginHandle != nullptr)
+                fCarlaPluginDescriptor->dispatcher(layer.rack.pluginHandle, NATIVE_PLUGIN_OPCODE_BUFFER_SIZE_CHANGED,
+                                                   0, newBufferSize, nullptr, 0.0f);
+        }
+       #endif
     }
 
     void sampleRateChanged(const double newSampleRate) override
     {
-        if (fCarlaPluginHandle != nullptr)
-            fCarlaPluginDescriptor->dispatcher(fCarlaPluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
+        resizeDelayLines(getBufferSize(), newSampleRate);
+
+        for (IldaeilRack& rack : fRacks)
+        {
+            if (rack.pluginHandle != nullptr)
+                fCarlaPluginDescriptor->dispatcher(rack.pluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
+                                                   0, 0, nullptr, newSampleRate);
+        }
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        cancelLatencyProbe();
+
+        if (fLatencyProbe.rack.pluginHandle != nullptr)
+            fCarlaPluginDescriptor->dispatcher(fLatencyProbe.rack.pluginHandle,
+                                               NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
                                                0, 0, nullptr, newSampleRate);
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        for (IldaeilLayer& layer : fLayers)
+        {
+            if (layer.rack.pluginHandle != nullptr)
+                fCarlaPluginDescriptor->dispatcher(layer.rack.pluginHandle, NATIVE_PLUGIN_OPCODE_SAMPLE_RATE_CHANGED,
+                                                   0, 0, nullptr, newSampleRate);
+        }
+       #endif
     }
 
     // -------------------------------------------------------------------------------------------------------
@@ -746,30 +2470,41 @@ protected:
 
 // -----------------------------------------------------------------------------------------------------------
 
+static IldaeilPlugin* getPluginFromRack(const NativeHostHandle handle)
+{
+    return static_cast<IldaeilPlugin*>(static_cast<IldaeilRack*>(handle)->plugin);
+}
+
 static uint32_t host_get_buffer_size(const NativeHostHandle handle)
 {
-    return static_cast<IldaeilPlugin*>(handle)->getBufferSize();
+    return getPluginFromRack(handle)->getBufferSize();
 }
 
 static double host_get_sample_rate(const NativeHostHandle handle)
 {
-    return static_cast<IldaeilPlugin*>(handle)->getSampleRate();
+    return getPluginFromRack(handle)->getSampleRate();
 }
 
-static bool host_is_offline(NativeHostHandle)
+static bool host_is_offline(const NativeHostHandle handle)
 {
-    return false;
+    return static_cast<IldaeilRack*>(handle)->offline;
 }
 
 static const NativeTimeInfo* host_get_time_info(const NativeHostHandle handle)
 {
-    return static_cast<IldaeilPlugin*>(handle)->hostGetTimeInfo();
+    return getPluginFromRack(handle)->hostGetTimeInfo(static_cast<IldaeilRack*>(handle));
 }
 
 static bool host_write_midi_event(const NativeHostHandle handle, const NativeMidiEvent* const event)
 {
 #if DISTRHO_PLUGIN_WANT_MIDI_OUTPUT
-    return static_cast<IldaeilPlugin*>(handle)->hostWriteMidiEvent(event);
+    IldaeilPlugin* const plugin = getPluginFromRack(handle);
+
+    // ignore events from the rack being faded in
+    if (! plugin->isAudioRack(static_cast<IldaeilRack*>(handle)))
+        return false;
+
+    return plugin->hostWriteMidiEvent(event);
 #else
     return handle != nullptr && event != nullptr && false;
 #endif
@@ -777,7 +2512,10 @@ static bool host_write_midi_event(const NativeHostHandle handle, const NativeMid
 
 static void host_ui_parameter_changed(const NativeHostHandle handle, const uint32_t index, const float value)
 {
-    ildaeilParameterChangeForUI(static_cast<IldaeilPlugin*>(handle)->fUI, index, value);
+    IldaeilPlugin* const plugin = getPluginFromRack(handle);
+
+    if (plugin->isUIRack(static_cast<IldaeilRack*>(handle)))
+        ildaeilParameterChangeForUI(plugin->fUI, sParameterQueue, index, value);
 }
 
 static void host_ui_midi_program_changed(NativeHostHandle handle, uint8_t channel, uint32_t bank, uint32_t program)
@@ -792,12 +2530,15 @@ static void host_ui_custom_data_changed(NativeHostHandle handle, const char* key
 
 static void host_ui_closed(NativeHostHandle handle)
 {
-    ildaeilCloseUI(static_cast<IldaeilPlugin*>(handle));
+    IldaeilPlugin* const plugin = getPluginFromRack(handle);
+
+    if (plugin->isUIRack(static_cast<IldaeilRack*>(handle)))
+        ildaeilCloseUI(plugin->fUI);
 }
 
 static const char* host_ui_open_file(const NativeHostHandle handle, const bool isDir, const char* const title, const char* const filter)
 {
-    return ildaeilOpenFileForUI(static_cast<IldaeilPlugin*>(handle)->fUI, isDir, title, filter);
+    return ildaeilOpenFileForUI(getPluginFromRack(handle)->fUI, isDir, title, filter);
 }
 
 static const char* host_ui_save_file(NativeHostHandle, bool, const char*, const char*)
@@ -808,7 +2549,7 @@ static const char* host_ui_save_file(NativeHostHandle, bool, const char*, const
 static intptr_t host_dispatcher(const NativeHostHandle handle, const NativeHostDispatcherOpcode opcode,
                                 const int32_t index, const intptr_t value, void* const ptr, const float opt)
 {
-    return static_cast<IldaeilPlugin*>(handle)->hostDispatcher(opcode, index, value, ptr, opt);
+    return getPluginFromRack(handle)->hostDispatcher(static_cast<IldaeilRack*>(handle), opcode, index, value, ptr, opt);
 }
 
 /* --------------------------------------------------------------------------------------------------------------------
@@ -24,34 +24,42 @@
 #endif
 
 #include "CarlaBackendUtils.hpp"
+#include "CarlaLv2Utils.hpp"
+#include "PluginGenericUI.hpp"
 #include "PluginHostWindow.hpp"
+#include "VST3ModuleInfo.hpp"
+#include "extra/RingBuffer.hpp"
 #include "extra/Runner.hpp"
+#include "extra/Thread.hpp"
+#include "extra/Time.hpp"
 
 // IDE helper
 #include "DearImGui.hpp"
 
+#include "water/files/DirectoryIterator.h"
 #include "water/files/File.h"
 #include "water/files/FileInputStream.h"
 #include "water/files/FileOutputStream.h"
 #include "water/memory/MemoryBlock.h"
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-// strcasestr
-#ifdef DISTRHO_OS_WINDOWS
-# include <shlwapi.h>
-namespace ildaeil {
-    inline const char* strcasestr(const char* const haystack, const char* const needle)
-    {
-        return StrStrIA(haystack, needle);
-    }
-    // using strcasestr = StrStrIA;
-}
-#else
-namespace ildaeil {
-    using ::strcasestr;
-}
+#if defined(CARLA_OS_LINUX)
+# include <fcntl.h>
+# include <sched.h>
+# include <pthread.h>
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#elif defined(CARLA_OS_MAC)
+# include <mach/mach.h>
+# include <sys/resource.h>
+#elif defined(CARLA_OS_WIN)
+# include <windows.h>
 #endif
 
 // #define WASM_TESTING
@@ -62,69 +70,330 @@ using namespace CARLA_BACKEND_NAMESPACE;
 
 // --------------------------------------------------------------------------------------------------------------------
 
-class IldaeilUI : public UI,
-                  public Runner,
-                  public PluginHostWindow::Callbacks
+// Lower CPU and I/O priority of the calling thread.
+// On Linux these are per-thread and inherited by the discovery processes spawned from it.
+static void setCurrentThreadLowPriority()
 {
-    static constexpr const uint kGenericWidth  = 380;
-    static constexpr const uint kGenericHeight = 400;
-    static constexpr const uint kButtonHeight  = 20;
+   #if defined(CARLA_OS_LINUX)
+    const pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
 
-    struct PluginInfoCache {
-        BinaryType btype;
-        uint64_t uniqueId;
-        std::string filename;
-        std::string name;
-        std::string label;
-    };
+    if (::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19) != 0)
+        d_stderr("Failed to set scanner thread nice level");
 
-    struct PluginGenericUI {
-        char* title = nullptr;
-        uint parameterCount = 0;
-        struct Parameter {
-            char* name = nullptr;
-            char* group = nullptr;
-            char* printformat = nullptr;
-            uint32_t rindex = 0;
-            bool boolean = false;
-            bool bvalue = false;
-            bool log = false;
-            bool readonly = false;
-            float min = 0.f;
-            float max = 1.f;
-            ~Parameter()
-            {
-                std::free(name);
-                std::free(group);
-                std::free(printformat);
-            }
-        }* parameters = nullptr;
-        float* values = nullptr;
-
-        uint presetCount = 0;
-        struct Preset {
-            uint32_t index = 0;
-            char* name = nullptr;
-            ~Preset()
+   #ifdef SCHED_IDLE
+    sched_param param = {};
+    if (::pthread_setschedparam(::pthread_self(), SCHED_IDLE, &param) != 0)
+        d_stderr("Failed to set scanner thread scheduling policy");
+   #endif
+
+   #ifdef SYS_ioprio_set
+    // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE; there is no libc wrapper for this one
+    if (::syscall(SYS_ioprio_set, 1, static_cast<int>(tid), 3 << 13) != 0)
+        d_stderr("Failed to set scanner thread I/O priority");
+   #endif
+   #elif defined(CARLA_OS_MAC)
+    ::setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+   #elif defined(CARLA_OS_WIN)
+    ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_IDLE);
+   #endif
+}
+
+// Resident memory of the whole process in bytes, or 0 if unknown.
+// Used to estimate how much a plugin costs by comparing before and after loading it.
+static size_t getProcessMemoryUsage()
+{
+   #if defined(CARLA_OS_LINUX)
+    size_t size = 0, resident = 0;
+
+    if (FILE* const file = std::fopen("/proc/self/statm", "r"))
+    {
+        if (std::fscanf(file, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        std::fclose(file);
+    }
+
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+   #elif defined(CARLA_OS_MAC)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (::task_info(::mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+
+    return info.resident_size;
+   #else
+    return 0;
+   #endif
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#ifndef DISTRHO_OS_WASM
+// Reads plugin files ahead of loading them, so they are already in the OS page cache when the plugin gets loaded.
+class PluginPrefetchThread : public Thread
+{
+    // avoid trashing the page cache with bundles full of samples
+    static constexpr const int64_t kMaxPrefetchSize = 256 * 1024 * 1024;
+
+    String fPath;
+
+public:
+    PluginPrefetchThread()
+        : Thread("IldaeilPrefetch") {}
+
+    ~PluginPrefetchThread() override
+    {
+        stopThread(-1);
+    }
+
+    // path can be a binary or a bundle directory; cancels any prefetch still in progress
+    void prefetch(const char* const path)
+    {
+        stopThread(-1);
+
+        fPath = path;
+        startThread();
+    }
+
+protected:
+    void run() override
+    {
+        const uint32_t startTime = d_gettime_ms();
+        const water::File file(fPath.buffer());
+        int64_t size = 0;
+
+        if (file.isDirectory())
+        {
+            for (water::DirectoryIterator it(file, true); size < kMaxPrefetchSize && it.next();)
             {
-                std::free(name);
+                if (shouldThreadExit())
+                    return;
+
+                size += prefetchFile(it.getFile(), kMaxPrefetchSize - size);
             }
-        }* presets = nullptr;
-        int currentPreset = -1;
-        const char** presetStrings = nullptr;
+        }
+        else
+        {
+            size = prefetchFile(file, kMaxPrefetchSize);
+        }
+
+        d_debug("Prefetched %lld bytes from %s in %u ms",
+                static_cast<long long>(size), fPath.buffer(), d_gettime_ms() - startTime);
+    }
+
+    int64_t prefetchFile(const water::File& file, const int64_t maxSize)
+    {
+        const int64_t size = std::min(file.getSize(), maxSize);
 
-        ~PluginGenericUI()
+        if (size <= 0)
+            return 0;
+
+       #ifdef CARLA_OS_LINUX
+        // let the kernel read it in the background
+        const int fd = ::open(file.getFullPathName().toRawUTF8(), O_RDONLY|O_CLOEXEC);
+
+        if (fd < 0)
+            return 0;
+
+        ::posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+        ::close(fd);
+        return size;
+       #else
+        water::FileInputStream stream(file);
+
+        if (! stream.openedOk())
+            return 0;
+
+        char buffer[64 * 1024];
+        int64_t total = 0;
+
+        while (total < size && ! shouldThreadExit())
         {
-            std::free(title);
-            delete[] parameters;
-            delete[] values;
-            delete[] presets;
-            delete[] presetStrings;
+            const int read = stream.read(buffer, sizeof(buffer));
+
+            if (read <= 0)
+                break;
+
+            total += read;
         }
+
+        return total;
+       #endif
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+// Instantiates a plugin away from the UI thread, carla swaps it with the previous one once ready.
+// The result is picked up by polling isFinished() from the UI thread and then calling getResult().
+class PluginLoaderThread : public Thread
+{
+    CarlaHostHandle fHandle = nullptr;
+    // plugin to add, or file to load if plugin type is PLUGIN_NONE
+    BinaryType fBinaryType = BINARY_NATIVE;
+    PluginType fPluginType = PLUGIN_NONE;
+    String fFilename, fName, fLabel;
+    int64_t fUniqueId = 0;
+    uint32_t fStartTime = 0;
+    // keep the new plugin from processing audio until the UI thread moves it into place
+    bool fAddInactive = false;
+    bool fResult = false;
+    std::atomic<bool> fFinished { false };
+
+public:
+    PluginLoaderThread()
+        : Thread("IldaeilLoader") {}
+
+    ~PluginLoaderThread() override
+    {
+        // carla_add_plugin cannot be interrupted, wait for it
+        stopThread(-1);
+    }
+
+    void loadPlugin(const CarlaHostHandle handle,
+                    const BinaryType btype,
+                    const PluginType ptype,
+                    const char* const filename,
+                    const char* const name,
+                    const char* const label,
+                    const int64_t uniqueId,
+                    const bool addInactive)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(! isThreadRunning(),);
+
+        fHandle = handle;
+        fAddInactive = addInactive;
+        fBinaryType = btype;
+        fPluginType = ptype;
+        fFilename = filename;
+        fName = name;
+        fLabel = label;
+        fUniqueId = uniqueId;
+        start();
+    }
+
+    void loadFile(const CarlaHostHandle handle, const char* const filename, const bool addInactive)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(! isThreadRunning(),);
+
+        fHandle = handle;
+        fAddInactive = addInactive;
+        fPluginType = PLUGIN_NONE;
+        fFilename = filename;
+        start();
+    }
+
+    bool isLoading() const noexcept
+    {
+        return isThreadRunning() && ! fFinished.load(std::memory_order_acquire);
+    }
+
+    bool isFinished() const noexcept
+    {
+        return fFinished.load(std::memory_order_acquire);
+    }
+
+    uint32_t getElapsedTime() const noexcept
+    {
+        return d_gettime_ms() - fStartTime;
+    }
+
+    // waits for the loader if needed, only valid to call once per load
+    bool getResult()
+    {
+        stopThread(-1);
+        fFinished.store(false, std::memory_order_release);
+        return fResult;
+    }
+
+protected:
+    void run() override
+    {
+        const MutexLocker cml(IldaeilBasePlugin::sPluginInfoLoadMutex);
+
+        if (fPluginType == PLUGIN_NONE)
+            fResult = carla_load_file(fHandle, fFilename);
+        else
+            fResult = carla_add_plugin(fHandle,
+                                       fBinaryType,
+                                       fPluginType,
+                                       fFilename,
+                                       fName,
+                                       fLabel,
+                                       fUniqueId,
+                                       nullptr,
+                                       PLUGIN_OPTIONS_NULL);
+
+        if (fResult && fAddInactive)
+            carla_set_active(fHandle, carla_get_current_plugin_count(fHandle) - 1, false);
+
+        fFinished.store(true, std::memory_order_release);
+    }
+
+private:
+    void start()
+    {
+        fResult = false;
+        fFinished.store(false, std::memory_order_release);
+        fStartTime = d_gettime_ms();
+
+        if (! startThread())
+            fFinished.store(true, std::memory_order_release);
+    }
+};
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+
+class IldaeilUI : public UI,
+                  public Runner,
+                  public PluginHostWindow::Callbacks
+{
+    static constexpr const uint kGenericWidth  = 380;
+    static constexpr const uint kGenericHeight = 400;
+    static constexpr const uint kButtonHeight  = 20;
+
+    // pause plugin discovery while our own audio processing uses more than this of its deadline
+    static constexpr const float kDiscoveryThrottleLoad = 0.6f;
+    // but never pause for longer than this, discovery tools time out if left without idle
+    static constexpr const uint32_t kDiscoveryThrottleMaxTime = 5000;
+    static constexpr const uint kDiscoveryThrottleSleepTime = 50;
+    static constexpr const uint kInProcessDiscoveryBatchSize = 16;
+    // how often the scanner thread makes newly found plugins visible to the UI
+    static constexpr const uint32_t kPluginCatalogPublishTime = 250;
+    // generic UI sections start collapsed for plugins with more parameters than this
+    static constexpr const uint kGenericUIMaxOpenParameters = 64;
+    static constexpr const uint kGenericUISearchMinParameters = 16;
+    // output parameter polling interval in ms, can be changed with ILDAEIL_OUTPUT_PARAMETER_RATE (in Hz)
+    static constexpr const uint kDefaultOutputParameterInterval = 50;
+    // hosted plugin UIs get idle from our own timer, in ms, faster while the user interacts with them
+    static constexpr const uint kHostedUIIdleFastInterval = 16;
+    static constexpr const uint kHostedUIIdleInterval = 33;
+    static constexpr const uint kHostedUIIdleSlowInterval = 100;
+    // time after the last interaction to go back to the normal rate, and to the slow one
+    static constexpr const uint32_t kHostedUIInteractionTime = 1000;
+    static constexpr const uint32_t kHostedUIStaticTime = 5000;
+    // how long closing the editor waits for a pending plugin swap to finish, in ms
+    static constexpr const uint32_t kSwapFinishTimeout = 500;
+    // plugin loading progress is redrawn at this interval in ms, nothing else changes on its own
+    static constexpr const uint32_t kPluginLoadingRepaintInterval = 50;
+    // frame statistics are reported at this interval in ms, in debug builds
+    static constexpr const uint32_t kFrameStatsInterval = 10000;
+
+    // never modified after being published, the scanner thread swaps in a new one instead
+    struct PluginCatalog {
+        // changes on rescan or when existing entries are replaced, not when new ones are added
+        uint generation = 0;
+        std::vector<PluginInfoCache> plugins;
+        // indexes into plugins to list, when showing all formats only the preferred one for each name and maker
+        std::vector<uint> entries;
+        // bitmask of formats available for each entry, as (1 << PluginType)
+        std::vector<uint32_t> entryFormats;
     };
 
     enum {
         kDrawingLoading,
+        kDrawingPluginLoading,
         kDrawingPluginError,
         kDrawingPluginList,
         kDrawingPluginEmbedUI,
@@ -139,9 +408,23 @@ class IldaeilUI : public UI,
         kIdleLoadSelectedPlugin,
         kIdlePluginLoadedFromDSP,
         kIdleResetPlugin,
+        kIdleCopySlot,
+        kIdleSwitchSlot,
+        kIdleSelectChainSlot,
+        kIdleMoveChainSlot,
+        kIdleRemoveChainSlot,
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        kIdleStartLatencyProbe,
+       #endif
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        kIdleSelectLayer,
+        kIdleAddLayer,
+        kIdleRemoveLayer,
+       #endif
         kIdleOpenFileUI,
         kIdleShowCustomUI,
         kIdleHideEmbedAndShowGenericUI,
+        kIdleSuspendEmbedAndShowGenericUI,
         kIdleHidePluginUI,
         kIdleGiveIdleToUI,
         kIdleChangePluginType,
@@ -151,6 +434,10 @@ class IldaeilUI : public UI,
     IldaeilBasePlugin* const fPlugin = static_cast<IldaeilBasePlugin*>(getPluginInstancePointer());
     void* const fNativeWindowHandle = reinterpret_cast<void*>(getWindow().getNativeWindowHandle());
     PluginHostWindow fPluginHostWindow { fNativeWindowHandle, this };
+   #ifndef DISTRHO_OS_WASM
+    PluginPrefetchThread fPluginPrefetchThread;
+    PluginLoaderThread fPluginLoaderThread;
+   #endif
 
     BinaryType fBinaryType = BINARY_NATIVE;
     PluginType fPluginType = PLUGIN_LV2;
@@ -161,19 +448,110 @@ class IldaeilUI : public UI,
     bool fPluginHasEmbedUI = false;
     bool fPluginHasResizableUI = false;
     bool fPluginHasFileOpen = false;
-    bool fPluginHasOutputParameters = false;
     bool fPluginIsBridge = false;
     bool fPluginIsIdling = false;
     bool fPluginRunning = false;
     bool fPluginWillRunInBridgeMode = false;
-    Mutex fPluginsMutex;
+    // embed UI kept instantiated but unmapped while showing the generic one, see IldaeilBasePlugin::getKeepEmbedUI
+    bool fPluginEmbedUISuspended = false;
+    // estimated memory used by the embed UI, measured when it gets suspended
+    size_t fEmbedUIMemoryUsage = 0;
+    size_t fEmbedUIMemoryBase = 0;
     PluginInfoCache fCurrentPluginInfo{};
-    std::vector<PluginInfoCache> fPlugins;
+    // plugin state right after loading, restored on reset instead of a full reload
+    String fPluginDefaultState;
+    // estimated memory used by the current plugin, 0 if unknown
+    size_t fPluginMemoryUsage = 0;
+    size_t fLoadingMemoryUsage = 0;
+    // A/B slot not in use, swapped with the current plugin details on switch
+    PluginSlot& fOtherSlot = fPlugin->fOtherSlotDetails;
+    // chain mode, the UI rack can hold several plugins processed in series and fPluginId is the one shown.
+    // details of the other plugins in the chain, indexed by plugin id (the entry for fPluginId is outdated)
+    std::vector<PluginSlot>& fChainSlots = fPlugin->fPluginChainDetails.chainSlots;
+    // next plugin gets appended to the chain instead of replacing the current one
+    bool fAddingToChain = false;
+    // plugin id to select or move to, for the chain idle actions
+    uint fNextChainSlot = 0;
+    // parameter changes from the DSP side are indexed across all plugins in the rack
+    uint32_t fChainParameterOffset = 0;
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // chain details of the layers not shown, kept for when switching back to them
+    PluginChainDetails (&fLayerDetails)[kIldaeilMaxLayers] = fPlugin->fLayerChainDetails;
+    uint fNextLayer = 0;
+   #endif
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    // latency probe is running on the DSP side, checked for completion on idle
+    bool fLatencyProbePending = false;
+   #endif
+    // plugin or file being loaded, becomes current once loading finishes
+    PluginInfoCache fLoadingPluginInfo{};
+    String fLoadingFilename;
+    CarlaHostHandle fLoadingHostHandle = nullptr;
+    bool fPluginLoadCancelled = false;
+    // plugin being loaded gets added at the end of the chain, then takes the place of fPluginId once loaded.
+    // until then the current plugin stays in place, so cancelling or failing the load keeps it.
+    bool fReplacingInPlace = false;
+    // new plugin is being crossfaded in, the previous one is removed once done
+    bool fPluginSwapPending = false;
+    // access only through std::atomic_load/store
+    std::shared_ptr<const PluginCatalog> fPluginCatalog = std::make_shared<const PluginCatalog>();
+    // incremented each time a catalog is published, so the UI knows when to redraw
+    std::atomic<uint> fPluginCatalogSerial { 0 };
     ScopedPointer<PluginGenericUI> fPluginGenericUI;
-
+    // output parameters are polled, the rest are only refreshed when the DSP side reports a change
+    struct ParameterChange {
+        uint32_t index;
+        float value;
+    };
+    static constexpr const uint32_t kParameterChangeQueueSize = 4096;
+    // ring buffers take a single writer, so each realtime thread processing racks gets its own queue.
+    // queue 0 is for everything else, where writers take turns through fParameterChangesWriteMutex.
+    HeapRingBuffer fParameterChanges[kIldaeilParameterQueueCount];
+    Mutex fParameterChangesWriteMutex;
+    std::atomic<bool> fParameterChangesOverflow { false };
+    uint fOutputParameterInterval = kDefaultOutputParameterInterval;
+    char fParameterSearchString[0xff] = {};
+    uint32_t fLastOutputParameterPoll = 0;
+
+    // hosted UI idle runs from this timer when possible, instead of at the rate the host calls uiIdle
+    struct HostedUIIdleTimer : IdleCallback {
+        IldaeilUI* const self;
+        explicit HostedUIIdleTimer(IldaeilUI* const s) : self(s) {}
+        void idleCallback() override { self->hostedUIIdle(); }
+    } fHostedUIIdleTimer { this };
+    // current timer interval in ms, 0 if not running
+    uint fHostedUIIdleInterval = 0;
+    bool fHostedUIIdleTimerFailed = false;
+    uint32_t fLastInteractionTime = 0;
+    // hosted UI idle cost, measured over about 1 second
+    uint64_t fHostedUIIdleTime = 0;
+    uint fHostedUIIdleCalls = 0;
+    uint32_t fHostedUIIdleMeasureStart = 0;
+    float fHostedUIIdleLoad = 0.f;
+    uint fHostedUIIdleRate = 0;
+
+    // what the last frame showed, uiIdle only repaints if this is outdated
+    // (input events and explicit repaint() calls for other changes still redraw as usual)
+    struct DisplayedState {
+        int drawingState = -1;
+        uint catalogSerial = 0;
+        uint32_t loadingStep = 0;
+    } fDisplayedState;
+    uint fFrameCount = 0;
+    uint64_t fFrameTime = 0;
+    uint32_t fFrameStatsStart = 0;
+    // time when the editor started to open, 0 after the first frame
+    uint32_t fOpenStartTime;
+
+    bool fPluginDiscoveryStarted = false;
     bool fPluginSearchActive = false;
     bool fPluginSearchFirstShow = false;
     char fPluginSearchString[0xff] = {};
+    // indexes into fPluginCatalog entries matching the current search, only updated when search or plugin list changes
+    std::vector<uint> fPluginSearchResults;
+    std::string fPluginSearchQuery;
+    uint fPluginSearchGeneration = 0;
+    size_t fPluginSearchIndexedCount = 0;
 
     String fPopupError, fPluginFilename, fDiscoveryTool;
     Size<uint> fCurrentConstraintSize, fLastSize, fNextSize;
@@ -185,10 +563,31 @@ class IldaeilUI : public UI,
     struct RunnerData {
         bool needsReinit = true;
         CarlaPluginDiscoveryHandle handle = nullptr;
+        uint cachedCount = 0;
+        uint cachedIndex = 0;
+        uint32_t startTime = 0;
+        uint32_t throttleTime = 0;
+        // plugin type being scanned now, and index of the next one for the "All formats" list
+        PluginType ptype = PLUGIN_NONE;
+        uint nextTypeIndex = 0;
+        // plugins found so far, private to the scanner thread until published
+        std::vector<PluginInfoCache> plugins;
+        std::vector<uint> entries;
+        std::vector<uint32_t> entryFormats;
+        // case-folded name and maker to index into entries
+        std::unordered_map<std::string, uint> entryGroups;
+        // lower is more preferred
+        uint formatRanks[PLUGIN_TYPE_COUNT];
+        uint generation = 0;
+        size_t publishedCount = 0;
+        uint32_t publishTime = 0;
 
         void init()
         {
             needsReinit = true;
+            cachedCount = cachedIndex = 0;
+            nextTypeIndex = 0;
+            throttleTime = 0;
 
             if (handle != nullptr)
             {
@@ -199,9 +598,10 @@ class IldaeilUI : public UI,
     } fRunnerData;
 
 public:
-    IldaeilUI()
+    explicit IldaeilUI(const uint32_t openStartTime)
         : UI(kInitialWidth, kInitialHeight),
-          Runner("IldaeilScanner")
+          Runner("IldaeilScanner"),
+          fOpenStartTime(openStartTime)
     {
         const double scaleFactor = getScaleFactor();
 
@@ -217,6 +617,17 @@ public:
 
         std::strcpy(fPluginSearchString, "Search...");
 
+        for (HeapRingBuffer& queue : fParameterChanges)
+            queue.createBuffer(sizeof(ParameterChange) * kParameterChangeQueueSize);
+
+        if (const char* const envRate = std::getenv("ILDAEIL_OUTPUT_PARAMETER_RATE"))
+        {
+            const int rate = std::atoi(envRate);
+
+            if (rate > 0)
+                fOutputParameterInterval = 1000 / std::min(rate, 1000);
+        }
+
         ImGuiStyle& style(ImGui::GetStyle());
         style.FrameRounding = 4 * scaleFactor;
 
@@ -236,13 +647,26 @@ public:
 
         const CarlaHostHandle handle = fPlugin->fCarlaHostHandle;
 
-        char winIdStr[24];
-        std::snprintf(winIdStr, sizeof(winIdStr), "%lx", (ulong)getWindow().getNativeWindowHandle());
-        carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_WIN_ID, 0, winIdStr);
-        carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_UI_SCALE, scaleFactor*1000, nullptr);
+        setupHostHandleForUI(handle);
+
+        // finish a swap left running by the last editor, this also loads an A/B slot restored by the host meanwhile
+        fPluginSwapPending = ! fPlugin->finishPluginSwap();
+
+        // show the same plugin of the chain as last time
+        if (fPlugin->fPluginChainDetails.pluginId < carla_get_current_plugin_count(handle))
+            fPluginId = fPlugin->fPluginChainDetails.pluginId;
 
         if (checkIfPluginIsLoaded())
+        {
             fIdleState = kIdleInitPluginAlreadyLoaded;
+            restoreChainSlot();
+
+            // reuse the generic UI model from last time, its values get refreshed when shown
+            if (fPlugin->fPluginGenericUICacheHandle == handle && fPlugin->fPluginGenericUICacheId == fPluginId)
+                fPluginGenericUI = fPlugin->fPluginGenericUICache.release();
+        }
+
+        fPlugin->fPluginGenericUICache = nullptr;
 
         fPlugin->fUI = this;
 
@@ -273,9 +697,49 @@ public:
         {
             fPlugin->fUI = nullptr;
 
-            if (fPluginRunning)
+            bool loading = false;
+
+           #ifndef DISTRHO_OS_WASM
+            // wait for any load in progress and finish it on the carla side,
+            // so an in-place replacement is not left inactive at the end of the chain
+            if (fDrawingState == kDrawingPluginLoading)
+            {
+                loading = true;
+                pluginLoadFinishedOnClose(fPluginLoaderThread.getResult());
+            }
+           #endif
+
+            // already hidden when the load started
+            if (fPluginRunning && ! loading)
                 hidePluginUI(fPlugin->fCarlaHostHandle);
 
+            // the audio thread ends the crossfade soon, or right away if deactivated.
+            // if it does not in time, the next swap tears down the old plugin instead.
+            if (fPluginSwapPending)
+            {
+                const uint32_t startTime = d_gettime_ms();
+
+                while (! fPlugin->finishPluginSwap() && d_gettime_ms() - startTime < kSwapFinishTimeout)
+                    d_msleep(1);
+            }
+
+            if (fHostedUIIdleInterval != 0)
+                getWindow().removeIdleCallback(&fHostedUIIdleTimer);
+
+            if (fPluginRunning && fPluginGenericUI != nullptr)
+            {
+                fPlugin->fPluginGenericUICache = fPluginGenericUI.release();
+                fPlugin->fPluginGenericUICacheHandle = fPlugin->fCarlaHostHandle;
+                fPlugin->fPluginGenericUICacheId = fPluginId;
+            }
+
+            // the rest of the chain details are already kept by the plugin
+            if (fPluginRunning)
+            {
+                storeChainSlot();
+                fPlugin->fPluginChainDetails.pluginId = fPluginId;
+            }
+
             carla_set_engine_option(fPlugin->fCarlaHostHandle, ENGINE_OPTION_FRONTEND_WIN_ID, 0, "0");
         }
 
@@ -283,6 +747,14 @@ public:
         fPluginGenericUI = nullptr;
     }
 
+    void setupHostHandleForUI(const CarlaHostHandle handle)
+    {
+        char winIdStr[24];
+        std::snprintf(winIdStr, sizeof(winIdStr), "%lx", (ulong)getWindow().getNativeWindowHandle());
+        carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_WIN_ID, 0, winIdStr);
+        carla_set_engine_option(handle, ENGINE_OPTION_FRONTEND_UI_SCALE, getScaleFactor()*1000, nullptr);
+    }
+
     bool checkIfPluginIsLoaded()
     {
         const CarlaHostHandle handle = fPlugin->fCarlaHostHandle;
@@ -325,25 +797,33 @@ public:
             fIdleState = kIdlePluginLoadedFromDSP;
     }
 
-    void changeParameterFromDSP(const uint32_t index, const float value)
+    // Queues the change, applied on the next idle together with any others.
+    // Called from the UI thread on carla idle and hosted UI edits and from the host thread while it restores a project,
+    // those share queue 0. The audio thread and the layer workers each write to their own queue without locking.
+    void changeParameterFromDSP(const uint queue, const uint32_t index, const float value)
     {
-        if (PluginGenericUI* const ui = fPluginGenericUI)
-        {
-            for (uint32_t i=0; i < ui->parameterCount; ++i)
-            {
-                if (ui->parameters[i].rindex != index)
-                    continue;
+        DISTRHO_SAFE_ASSERT_RETURN(queue < kIldaeilParameterQueueCount,);
 
-                ui->values[i] = value;
+        const ParameterChange change = { index, value };
 
-                if (ui->parameters[i].boolean)
-                    ui->parameters[i].bvalue = value > ui->parameters[i].min;
-
-                break;
-            }
+        if (queue == 0)
+        {
+            const MutexLocker cml(fParameterChangesWriteMutex);
+            writeParameterChange(fParameterChanges[0], change);
         }
+        else
+        {
+            writeParameterChange(fParameterChanges[queue], change);
+        }
+    }
 
-        repaint();
+    void writeParameterChange(HeapRingBuffer& queue, const ParameterChange& change)
+    {
+        queue.writeCustomType(change);
+
+        // discards the write if the queue is full, everything gets refreshed instead
+        if (! queue.commitWrite())
+            fParameterChangesOverflow.store(true, std::memory_order_release);
     }
 
     void resizeUI(const uint32_t width, const uint32_t height)
@@ -367,7 +847,8 @@ public:
 
     const char* openFileFromDSP(const bool /*isDir*/, const char* const title, const char* const /*filter*/)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(fPluginType == PLUGIN_INTERNAL || fPluginType == PLUGIN_LV2, nullptr);
+        const PluginType ptype = carla_get_plugin_info(fPlugin->fCarlaHostHandle, fPluginId)->type;
+        DISTRHO_SAFE_ASSERT_RETURN(ptype == PLUGIN_INTERNAL || ptype == PLUGIN_LV2, nullptr);
 
         FileBrowserOptions opts;
         opts.title = title;
@@ -375,117 +856,322 @@ public:
         return nullptr;
     }
 
-    void showPluginUI(const CarlaHostHandle handle, const bool showIfNotEmbed)
+    uint getChainLength() const
     {
-       #ifndef DISTRHO_OS_WASM
-        const uint hints = carla_get_plugin_info(handle, fPluginId)->hints;
-
-        if (hints & PLUGIN_HAS_CUSTOM_EMBED_UI)
-        {
-            fDrawingState = kDrawingPluginEmbedUI;
-            fIdleState = kIdleGiveIdleToUI;
-            fPluginHasCustomUI = true;
-            fPluginHasEmbedUI = true;
-            fPluginHasResizableUI = hints & PLUGIN_HAS_CUSTOM_RESIZABLE_UI;
-            fPluginHasFileOpen = false;
-
-            fIgnoreNextHostWindowResize = false;
-            fInitialHostWindowShow = true;
-            fShowingHostWindow = true;
-
-           #if DISTRHO_UI_USER_RESIZABLE
-            // getWindow().setResizable(fPluginHasResizableUI);
-           #endif
+        return fPluginRunning ? carla_get_current_plugin_count(fPlugin->fCarlaHostHandle) : 0;
+    }
 
-            fPluginHostWindow.restart();
-            carla_embed_custom_ui(handle, fPluginId, fNativeWindowHandle);
-            fPluginHostWindow.idle();
-        }
-        else
-       #endif
-        {
-           #if DISTRHO_UI_USER_RESIZABLE
-            // getWindow().setResizable(true);
-           #endif
+    PluginSlot& getChainSlot(const uint pluginId)
+    {
+        if (fChainSlots.size() <= pluginId)
+            fChainSlots.resize(pluginId + 1);
 
-            // fPluginHas* flags are updated in the next function
-            createOrUpdatePluginGenericUI(handle);
+        return fChainSlots[pluginId];
+    }
 
-            if (showIfNotEmbed && fPluginHasCustomUI)
-            {
-                fIdleState = kIdleGiveIdleToUI;
-                carla_show_custom_ui(handle, fPluginId, true);
-            }
-        }
+    // Keep details of the plugin currently shown, before showing another one in the chain.
+    void storeChainSlot()
+    {
+        PluginSlot& slot(getChainSlot(fPluginId));
+        slot.info = fCurrentPluginInfo;
+        slot.filename = fPluginFilename;
+        slot.defaultState = fPluginDefaultState;
+        slot.memoryUsage = fPluginMemoryUsage;
+    }
 
-        repaint();
+    void restoreChainSlot()
+    {
+        const PluginSlot& slot(getChainSlot(fPluginId));
+        fCurrentPluginInfo = slot.info;
+        fPluginFilename = slot.filename;
+        fPluginDefaultState = slot.defaultState;
+        fPluginMemoryUsage = slot.memoryUsage;
     }
 
-    void hidePluginUI(const CarlaHostHandle handle)
+    void selectChainSlot(const CarlaHostHandle handle, const uint pluginId)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(fPluginRunning,);
+        DISTRHO_SAFE_ASSERT_RETURN(pluginId < getChainLength(),);
 
-        fPluginHostWindow.hide();
-        carla_show_custom_ui(handle, fPluginId, false);
+        if (pluginId == fPluginId)
+            return;
 
-       #if DISTRHO_UI_USER_RESIZABLE
-        // getWindow().setResizable(true);
-       #endif
+        hidePluginUI(handle);
+        storeChainSlot();
+
+        fPluginId = pluginId;
+        restoreChainSlot();
+
+        fPluginGenericUI = nullptr;
+        showPluginUI(handle, false);
     }
 
-    void createOrUpdatePluginGenericUI(const CarlaHostHandle handle, const CarlaPluginInfo* info = nullptr)
+    // Move the plugin currently shown to another position in the chain, it stays selected.
+    void moveChainSlot(const CarlaHostHandle handle, const uint pluginId)
     {
-        if (info == nullptr)
-            info = carla_get_plugin_info(handle, fPluginId);
+        DISTRHO_SAFE_ASSERT_RETURN(pluginId < getChainLength(),);
 
-        fDrawingState = kDrawingPluginGenericUI;
-        updatePluginFlags(info->hints);
+        if (pluginId == fPluginId)
+            return;
 
-        if (fPluginGenericUI == nullptr)
-            createPluginGenericUI(handle, info);
+        hidePluginUI(handle);
+
+        if (carla_switch_plugins(handle, fPluginId, pluginId))
+        {
+            getChainSlot(std::max(fPluginId, pluginId));
+            std::swap(fChainSlots[fPluginId], fChainSlots[pluginId]);
+            fPluginId = pluginId;
+        }
         else
-            updatePluginGenericUI(handle);
+        {
+            d_stderr("Failed to move plugin in chain: %s", carla_get_last_error(handle));
+        }
 
-        const double scaleFactor = getScaleFactor();
-        fNextSize = Size<uint>(kGenericWidth * scaleFactor,
-                               (kGenericHeight + ImGui::GetStyle().WindowPadding.y) * scaleFactor);
-        fLastSize = Size<uint>();
-        fUpdateGeometryConstraints = true;
+        // same plugin, generic UI stays valid
+        showPluginUI(handle, false);
     }
 
-    void createPluginGenericUI(const CarlaHostHandle handle, const CarlaPluginInfo* const info)
+    void removeChainSlot(const CarlaHostHandle handle)
     {
-        PluginGenericUI* const ui = new PluginGenericUI;
+        const uint count = getChainLength();
+        DISTRHO_SAFE_ASSERT_RETURN(count > 1,);
 
-        String title(info->name);
-        title += " by ";
-        title += info->maker;
-        ui->title = title.getAndReleaseBuffer();
+        hidePluginUI(handle);
 
-        fPluginHasOutputParameters = false;
+        if (! carla_remove_plugin(handle, fPluginId))
+        {
+            d_stderr("Failed to remove plugin from chain: %s", carla_get_last_error(handle));
+            showPluginUI(handle, false);
+            return;
+        }
 
-        const uint32_t parameterCount = ui->parameterCount = carla_get_parameter_count(handle, fPluginId);
+        if (fPluginId < fChainSlots.size())
+            fChainSlots.erase(fChainSlots.begin() + fPluginId);
 
-        // make count of valid parameters
-        for (uint32_t i=0; i < parameterCount; ++i)
+        // select the next one, or the previous one if removing the last
+        if (fPluginId == count - 1)
+            --fPluginId;
+
+        restoreChainSlot();
+
+        fPluginGenericUI = nullptr;
+        showPluginUI(handle, false);
+    }
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    // Show another layer, the chain details of the current one are kept for when coming back to it.
+    void selectPluginLayer(const CarlaHostHandle handle, const uint layer)
+    {
+        const uint currentLayer = fPlugin->getSelectedLayer();
+
+        // the main rack handle changes during a swap
+        if (layer == currentLayer || ! checkPluginSwapFinished())
+            return;
+
+        if (fPluginRunning)
         {
-            const ParameterData* const pdata = carla_get_parameter_data(handle, fPluginId, i);
+            hidePluginUI(handle);
+            storeChainSlot();
+        }
 
-            if ((pdata->hints & PARAMETER_IS_ENABLED) == 0x0)
+        fLayerDetails[currentLayer].chainSlots.swap(fChainSlots);
+        fLayerDetails[currentLayer].pluginId = fPluginId;
+
+        fPlugin->selectLayer(layer);
+
+        const CarlaHostHandle newHandle = fPlugin->fCarlaHostHandle;
+        setupHostHandleForUI(newHandle);
+
+        fChainSlots.clear();
+        fChainSlots.swap(fLayerDetails[layer].chainSlots);
+        fPluginId = fLayerDetails[layer].pluginId;
+        fAddingToChain = false;
+        fPluginGenericUI = nullptr;
+        fPluginRunning = false;
+
+        // changed from the DSP side in the meantime
+        if (fPluginId >= carla_get_current_plugin_count(newHandle))
+        {
+            fPluginId = 0;
+            fChainSlots.clear();
+        }
+
+        restoreChainSlot();
+
+        if (checkIfPluginIsLoaded())
+        {
+            showPluginUI(newHandle, false);
+            return;
+        }
+
+        const double scaleFactor = getScaleFactor();
+
+        fDrawingState = kDrawingPluginList;
+        fNextSize = Size<uint>(kInitialWidth * scaleFactor, kInitialHeight * scaleFactor);
+        fLastSize = Size<uint>();
+        fUpdateGeometryConstraints = true;
+        repaint();
+    }
+
+    void addPluginLayer(const CarlaHostHandle handle)
+    {
+        if (! fPlugin->addLayer())
+        {
+            d_stderr("Failed to add layer");
+            return;
+        }
+
+        selectPluginLayer(handle, fPlugin->getLayerCount() - 1);
+    }
+
+    // Only the last layer can be removed, the one before it gets shown instead.
+    void removePluginLayer(const CarlaHostHandle handle)
+    {
+        const uint layer = fPlugin->getSelectedLayer();
+        DISTRHO_SAFE_ASSERT_RETURN(layer != 0 && layer + 1 == fPlugin->getLayerCount(),);
+
+        selectPluginLayer(handle, layer - 1);
+
+        if (fPlugin->getSelectedLayer() == layer)
+            return;
+
+        if (fPlugin->removeLastLayer())
+            fLayerDetails[layer] = PluginChainDetails();
+    }
+   #endif
+
+    void showPluginUI(const CarlaHostHandle handle, const bool showIfNotEmbed)
+    {
+        fChainParameterOffset = 0;
+
+        for (uint i = 0; i < fPluginId; ++i)
+            fChainParameterOffset += carla_get_parameter_count(handle, i);
+
+       #ifndef DISTRHO_OS_WASM
+        const uint hints = carla_get_plugin_info(handle, fPluginId)->hints;
+
+        if (hints & PLUGIN_HAS_CUSTOM_EMBED_UI)
+        {
+            fDrawingState = kDrawingPluginEmbedUI;
+            fIdleState = kIdleGiveIdleToUI;
+            fPluginHasCustomUI = true;
+            fPluginHasEmbedUI = true;
+            fPluginHasResizableUI = hints & PLUGIN_HAS_CUSTOM_RESIZABLE_UI;
+            fPluginHasFileOpen = false;
+
+            fIgnoreNextHostWindowResize = false;
+            fInitialHostWindowShow = true;
+            fShowingHostWindow = true;
+
+           #if DISTRHO_UI_USER_RESIZABLE
+            // getWindow().setResizable(fPluginHasResizableUI);
+           #endif
+
+            if (fPluginEmbedUISuspended)
             {
-                --ui->parameterCount;
-                continue;
+                // still instantiated, just map it again
+                fPluginEmbedUISuspended = false;
+                fPluginHostWindow.resume();
+            }
+            else
+            {
+                fEmbedUIMemoryBase = getProcessMemoryUsage();
+                fPluginHostWindow.restart();
+                carla_embed_custom_ui(handle, fPluginId, fNativeWindowHandle);
             }
 
-            if (pdata->type == PARAMETER_OUTPUT)
-                fPluginHasOutputParameters = true;
+            fPluginHostWindow.idle();
+        }
+        else
+       #endif
+        {
+           #if DISTRHO_UI_USER_RESIZABLE
+            // getWindow().setResizable(true);
+           #endif
+
+            // fPluginHas* flags are updated in the next function
+            createOrUpdatePluginGenericUI(handle);
+
+            if (showIfNotEmbed && fPluginHasCustomUI)
+            {
+                fIdleState = kIdleGiveIdleToUI;
+                carla_show_custom_ui(handle, fPluginId, true);
+            }
         }
 
-        ui->parameters = new PluginGenericUI::Parameter[ui->parameterCount];
-        ui->values = new float[ui->parameterCount];
+        repaint();
+    }
 
-        // now safely fill in details
-        for (uint32_t i=0, j=0; i < parameterCount; ++i)
+    void hidePluginUI(const CarlaHostHandle handle)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPluginRunning,);
+
+        fPluginHostWindow.hide();
+        carla_show_custom_ui(handle, fPluginId, false);
+
+        fPluginEmbedUISuspended = false;
+        fEmbedUIMemoryUsage = 0;
+
+       #if DISTRHO_UI_USER_RESIZABLE
+        // getWindow().setResizable(true);
+       #endif
+    }
+
+    // Hide the embed UI without closing it, falls back to a regular hide if there is nothing to suspend.
+    void suspendPluginUI(const CarlaHostHandle handle)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPluginRunning,);
+
+        if (! fPluginHostWindow.suspend())
+        {
+            hidePluginUI(handle);
+            return;
+        }
+
+        const size_t memoryUsage = getProcessMemoryUsage();
+        fEmbedUIMemoryUsage = memoryUsage > fEmbedUIMemoryBase ? memoryUsage - fEmbedUIMemoryBase : 0;
+        fPluginEmbedUISuspended = true;
+    }
+
+    void createOrUpdatePluginGenericUI(const CarlaHostHandle handle, const CarlaPluginInfo* info = nullptr)
+    {
+        if (info == nullptr)
+            info = carla_get_plugin_info(handle, fPluginId);
+
+        fDrawingState = kDrawingPluginGenericUI;
+        updatePluginFlags(info->hints);
+
+        if (fPluginGenericUI == nullptr)
+            createPluginGenericUI(handle, info);
+        else
+            updatePluginGenericUI(handle);
+
+        const double scaleFactor = getScaleFactor();
+        fNextSize = Size<uint>(kGenericWidth * scaleFactor,
+                               (kGenericHeight + ImGui::GetStyle().WindowPadding.y) * scaleFactor);
+        fLastSize = Size<uint>();
+        fUpdateGeometryConstraints = true;
+    }
+
+    void createPluginGenericUI(const CarlaHostHandle handle, const CarlaPluginInfo* const info)
+    {
+        PluginGenericUI* const ui = new PluginGenericUI;
+        ui->strings.push_back('\0');
+
+        String title(info->name);
+        title += " by ";
+        title += info->maker;
+        ui->title = ui->addString(title);
+
+        const uint32_t parameterCount = carla_get_parameter_count(handle, fPluginId);
+
+        ui->parameters.reserve(parameterCount);
+        ui->values.reserve(parameterCount);
+        ui->rindexToSlot.assign(parameterCount, PluginGenericUI::kInvalidSlot);
+
+        std::string lastGroup;
+
+        // ranges and values are skipped here, see loadPluginGenericUIParameter
+        for (uint32_t i=0; i < parameterCount; ++i)
         {
             const ParameterData* const pdata = carla_get_parameter_data(handle, fPluginId, i);
 
@@ -493,7 +1179,21 @@ public:
                 continue;
 
             const CarlaParameterInfo* const pinfo = carla_get_parameter_info(handle, fPluginId, i);
-            const ::ParameterRanges* const pranges = carla_get_parameter_ranges(handle, fPluginId, i);
+
+            // carla groups are "symbol:name", only the name is shown
+            const char* const groupName = std::strchr(pinfo->groupName, ':');
+            const char* const group = groupName != nullptr ? groupName + 1 : "";
+
+            if (ui->sections.empty() || lastGroup != group)
+            {
+                PluginGenericUI::Section section;
+                section.name = group[0] != '\0' ? ui->addString(group) : 0;
+                section.first = ui->parameters.size();
+                ui->sections.push_back(section);
+                lastGroup = group;
+            }
+
+            ++ui->sections.back().count;
 
             String printformat;
 
@@ -504,64 +1204,188 @@ public:
 
             printformat += pinfo->unit;
 
-            PluginGenericUI::Parameter& param(ui->parameters[j]);
-            param.name = strdup(pinfo->name);
-            if (const char* const groupName = std::strchr(pinfo->groupName, ':'))
-                param.group = strdup(groupName + 1);
-            param.printformat = printformat.getAndReleaseBuffer();
+            PluginGenericUI::Parameter param;
+            param.name = ui->addString(pinfo->name);
+            param.printformat = ui->addString(printformat);
+            param.searchKey = ui->addString(foldSearchString(std::string(pinfo->name) + "\n" + group).c_str());
             param.rindex = i;
             param.boolean = pdata->hints & PARAMETER_IS_BOOLEAN;
             param.log = pdata->hints & PARAMETER_IS_LOGARITHMIC;
             param.readonly = pdata->type != PARAMETER_INPUT || (pdata->hints & PARAMETER_IS_READ_ONLY);
-            param.min = pranges->min;
-            param.max = pranges->max;
 
-            ui->values[j] = carla_get_current_parameter_value(handle, fPluginId, i);
-
-            if (param.boolean)
-                param.bvalue = ui->values[j] > param.min;
-            else
-                param.bvalue = false;
+            if (pdata->type == PARAMETER_OUTPUT)
+                ui->outputParameters.push_back(ui->parameters.size());
 
-            ++j;
+            ui->rindexToSlot[i] = ui->parameters.size();
+            ui->parameters.push_back(param);
+            ui->values.push_back(0.f);
         }
 
+        // keep big plugins fast to open, named sections start collapsed
+        const bool openSections = ui->parameters.size() <= kGenericUIMaxOpenParameters;
+
+        for (PluginGenericUI::Section& section : ui->sections)
+            section.open = section.name == 0 || openSections;
+
         // handle presets too
-        const uint32_t presetCount = ui->presetCount = carla_get_program_count(handle, fPluginId);
+        const uint32_t presetCount = carla_get_program_count(handle, fPluginId);
+        std::vector<uint32_t> presetNames;
 
         for (uint32_t i=0; i < presetCount; ++i)
         {
             const char* const pname = carla_get_program_name(handle, fPluginId, i);
 
             if (pname[0] == '\0')
-            {
-                --ui->presetCount;
                 continue;
-            }
+
+            ui->presetIndexes.push_back(i);
+            presetNames.push_back(ui->addString(pname));
         }
 
-        ui->presets = new PluginGenericUI::Preset[ui->presetCount];
-        ui->presetStrings = new const char*[ui->presetCount];
+        // no more strings are added after this point, so pointers into them stay valid
+        for (const uint32_t name : presetNames)
+            ui->presetStrings.push_back(ui->getString(name));
+
+        ui->currentPreset = -1;
+
+        fParameterSearchString[0] = '\0';
+        fPluginGenericUI = ui;
+    }
+
+    void loadPluginGenericUIParameter(const CarlaHostHandle handle, PluginGenericUI* const ui, const uint index)
+    {
+        PluginGenericUI::Parameter& param(ui->parameters[index]);
+
+        if (param.loaded)
+            return;
+
+        const ::ParameterRanges* const pranges = carla_get_parameter_ranges(handle, fPluginId, param.rindex);
+
+        param.loaded = true;
+        param.min = pranges->min;
+        param.max = pranges->max;
+
+        ui->values[index] = carla_get_current_parameter_value(handle, fPluginId, param.rindex);
+        param.bvalue = param.boolean && ui->values[index] > param.min;
+    }
+
+    // Rebuild the list of rows to draw, if sections were toggled or the search changed.
+    void updatePluginGenericUIRows(PluginGenericUI* const ui)
+    {
+        const std::string query(foldSearchString(fParameterSearchString));
+
+        if (! ui->rowsNeedUpdate && query == ui->rowsQuery)
+            return;
+
+        ui->rowsNeedUpdate = false;
+        ui->rowsQuery = query;
+        ui->rows.clear();
 
-        for (uint32_t i=0, j=0; i < presetCount; ++i)
+        for (uint s = 0; s < ui->sections.size(); ++s)
         {
-            const char* const pname = carla_get_program_name(handle, fPluginId, i);
+            const PluginGenericUI::Section& section(ui->sections[s]);
+            const size_t headerRow = ui->rows.size();
 
-            if (pname[0] == '\0')
+            if (section.name != 0)
+                ui->rows.push_back(PluginGenericUI::kSectionRow | s);
+
+            // search results include collapsed sections
+            if (query.empty() && ! section.open)
                 continue;
 
-            PluginGenericUI::Preset& preset(ui->presets[j]);
-            preset.index = i;
-            preset.name = strdup(pname);
+            for (uint i = section.first; i < section.first + section.count; ++i)
+            {
+                if (query.empty() || std::strstr(ui->getString(ui->parameters[i].searchKey), query.c_str()) != nullptr)
+                    ui->rows.push_back(i);
+            }
+
+            // hide sections without any match
+            if (! query.empty() && section.name != 0 && ui->rows.size() == headerRow + 1)
+                ui->rows.pop_back();
+        }
+    }
+
+    static bool setPluginGenericUIValue(PluginGenericUI* const ui, const uint index, const float value)
+    {
+        if (d_isEqual(ui->values[index], value))
+            return false;
+
+        ui->values[index] = value;
+
+        PluginGenericUI::Parameter& param(ui->parameters[index]);
+
+        if (param.boolean)
+            param.bvalue = value > param.min;
 
-            ui->presetStrings[j] = preset.name;
+        return true;
+    }
+
+    // Apply all parameter changes queued by the DSP side, to be called once per idle.
+    // Returns true if any displayed value changed.
+    bool applyParameterChanges(const CarlaHostHandle handle)
+    {
+        PluginGenericUI* const ui = fPluginGenericUI;
+        bool changed = false;
+
+        // changes are in order within each queue, which is all that matters for a parameter changed by one thread
+        for (HeapRingBuffer& queue : fParameterChanges)
+        {
+            ParameterChange change;
+            while (queue.isDataAvailableForReading() && queue.readCustomType(change))
+            {
+                if (ui == nullptr || change.index < fChainParameterOffset)
+                    continue;
+
+                const uint32_t rindex = change.index - fChainParameterOffset;
+
+                if (rindex >= ui->rindexToSlot.size())
+                    continue;
 
-            ++j;
+                const uint slot = ui->rindexToSlot[rindex];
+
+                if (slot != PluginGenericUI::kInvalidSlot)
+                    changed |= setPluginGenericUIValue(ui, slot, change.value);
+            }
         }
 
-        ui->currentPreset = -1;
+        if (fParameterChangesOverflow.exchange(false, std::memory_order_acquire) && ui != nullptr)
+        {
+            updatePluginGenericUI(handle);
+            changed = true;
+        }
 
-        fPluginGenericUI = ui;
+        return changed;
+    }
+
+    // Poll output parameters at a limited rate, returns true if any value changed.
+    bool pollOutputParameters(const CarlaHostHandle handle)
+    {
+        PluginGenericUI* const ui = fPluginGenericUI;
+        DISTRHO_SAFE_ASSERT_RETURN(ui != nullptr, false);
+
+        if (ui->outputParameters.empty())
+            return false;
+
+        const uint32_t time = d_gettime_ms();
+
+        if (time - fLastOutputParameterPoll < fOutputParameterInterval)
+            return false;
+
+        fLastOutputParameterPoll = time;
+
+        bool changed = false;
+
+        for (const uint index : ui->outputParameters)
+        {
+            // not shown yet, gets its value once loaded
+            if (! ui->parameters[index].loaded)
+                continue;
+
+            const float value = carla_get_current_parameter_value(handle, fPluginId, ui->parameters[index].rindex);
+            changed |= setPluginGenericUIValue(ui, index, value);
+        }
+
+        return changed;
     }
 
     void updatePluginGenericUI(const CarlaHostHandle handle)
@@ -569,50 +1393,384 @@ public:
         PluginGenericUI* const ui = fPluginGenericUI;
         DISTRHO_SAFE_ASSERT_RETURN(ui != nullptr,);
 
-        for (uint32_t i=0; i < ui->parameterCount; ++i)
+        for (uint32_t i=0; i < ui->parameters.size(); ++i)
+        {
+            if (! ui->parameters[i].loaded)
+                continue;
+
+            ui->values[i] = carla_get_current_parameter_value(handle, fPluginId, ui->parameters[i].rindex);
+
+            if (ui->parameters[i].boolean)
+                ui->parameters[i].bvalue = ui->values[i] > ui->parameters[i].min;
+        }
+    }
+
+    bool resetPluginState(const CarlaHostHandle handle)
+    {
+        if (fPluginDefaultState.isEmpty())
+            return false;
+
+        const uint32_t startTime = d_gettime_ms();
+
+        if (! IldaeilBasePlugin::loadPluginState(handle, fPluginId, fPluginDefaultState))
+            return false;
+
+        d_debug("Reset plugin state in %u ms", d_gettime_ms() - startTime);
+
+        if (fPluginGenericUI != nullptr)
+            updatePluginGenericUI(handle);
+
+        repaint();
+        return true;
+    }
+
+    bool checkPluginSwapFinished()
+    {
+        if (fPluginSwapPending && fPlugin->finishPluginSwap())
+            fPluginSwapPending = false;
+
+        return !fPluginSwapPending;
+    }
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    void startLatencyProbe()
+    {
+        if (fLatencyProbePending || ! checkPluginSwapFinished())
+            return;
+
+        fLatencyProbePending = fPlugin->startLatencyProbe();
+
+        if (! fLatencyProbePending)
+            d_stderr("Failed to start latency probe");
+    }
+
+    void checkLatencyProbeFinished()
+    {
+        if (fLatencyProbePending && fPlugin->finishLatencyProbe())
+        {
+            fLatencyProbePending = false;
+            repaint();
+        }
+    }
+   #endif
+
+    // Returns the handle to load a new plugin into.
+    // If possible this is a separate rack, so the current plugin keeps running until the new one is ready.
+    CarlaHostHandle prepareHostHandleForLoad(const CarlaHostHandle handle, const bool bridge)
+    {
+        CarlaHostHandle loadHandle = handle;
+        fReplacingInPlace = false;
+
+        if (fAddingToChain)
+        {
+            // appended at the end of the chain, current plugin stays as-is
+            hidePluginUI(handle);
+        }
+        else if (fPluginRunning || fPluginId != 0)
+        {
+            hidePluginUI(handle);
+
+            // gapless swap replaces the whole rack, only possible without a chain
+            const CarlaHostHandle swapHandle = fPluginRunning && getChainLength() == 1 && checkPluginSwapFinished()
+                                             ? fPlugin->getSwapHostHandle()
+                                             : nullptr;
+
+            if (swapHandle != nullptr)
+            {
+                setupHostHandleForUI(swapHandle);
+                loadHandle = swapHandle;
+            }
+            else
+            {
+                fReplacingInPlace = carla_get_current_plugin_count(handle) > fPluginId;
+            }
+        }
+
+        carla_set_engine_option(loadHandle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, bridge, nullptr);
+
+        fLoadingHostHandle = loadHandle;
+        fLoadingMemoryUsage = getProcessMemoryUsage();
+        return loadHandle;
+    }
+
+    void copyPluginSlot()
+    {
+        if (! checkPluginSwapFinished())
+            return;
+
+        const size_t memoryUsage = getProcessMemoryUsage();
+
+        if (! fPlugin->copyToOtherSlot())
+        {
+            d_stderr("Failed to copy plugin into the other slot");
+            return;
+        }
+
+        const size_t newMemoryUsage = getProcessMemoryUsage();
+
+        fOtherSlot.info = fCurrentPluginInfo;
+        fOtherSlot.filename = fPluginFilename;
+        fOtherSlot.defaultState = fPluginDefaultState;
+        fOtherSlot.memoryUsage = newMemoryUsage > memoryUsage ? newMemoryUsage - memoryUsage : 0;
+    }
+
+    void switchPluginSlot(const CarlaHostHandle handle)
+    {
+        if (! checkPluginSwapFinished())
+            return;
+
+        // first switch duplicates the current plugin, so both slots start the same
+        if (fPlugin->getOtherSlotHostHandle() == nullptr)
+        {
+            copyPluginSlot();
+
+            if (fPlugin->getOtherSlotHostHandle() == nullptr)
+                return;
+        }
+
+        hidePluginUI(handle);
+
+        if (! fPlugin->switchSlot())
+        {
+            showPluginUI(handle, false);
+            return;
+        }
+
+        fPluginSwapPending = true;
+
+        PluginSlot previous;
+        previous.info = fCurrentPluginInfo;
+        previous.filename = fPluginFilename;
+        previous.defaultState = fPluginDefaultState;
+        previous.memoryUsage = fPluginMemoryUsage;
+
+        fCurrentPluginInfo = fOtherSlot.info;
+        fPluginFilename = fOtherSlot.filename;
+        fPluginDefaultState = fOtherSlot.defaultState;
+        fPluginMemoryUsage = fOtherSlot.memoryUsage;
+        fOtherSlot = previous;
+        fChainSlots.clear();
+
+        const CarlaHostHandle newHandle = fPlugin->fCarlaHostHandle;
+        setupHostHandleForUI(newHandle);
+
+        fPluginGenericUI = nullptr;
+        showPluginUI(newHandle, false);
+    }
+
+    void loadPlugin(const CarlaHostHandle currentHandle, const PluginInfoCache& info)
+    {
+        const CarlaHostHandle handle = prepareHostHandleForLoad(currentHandle,
+                                                                fPluginWillRunInBridgeMode
+                                                                && canRunInBridgeMode(info.ptype));
+
+        fLoadingPluginInfo = info;
+        fLoadingFilename.clear();
+
+       #ifndef DISTRHO_OS_WASM
+        if (canLoadPluginInBackground(info.ptype))
+        {
+            fPluginLoaderThread.loadPlugin(handle,
+                                           info.btype,
+                                           info.ptype,
+                                           info.filename.c_str(),
+                                           info.name.c_str(),
+                                           info.label.c_str(),
+                                           info.uniqueId,
+                                           fReplacingInPlace);
+            startLoadingState();
+            return;
+        }
+       #endif
+
+        const uint32_t startTime = d_gettime_ms();
+        bool ok;
+        {
+            const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
+
+            ok = carla_add_plugin(handle,
+                                  info.btype,
+                                  info.ptype,
+                                  info.filename.c_str(),
+                                  info.name.c_str(),
+                                  info.label.c_str(),
+                                  info.uniqueId,
+                                  nullptr,
+                                  PLUGIN_OPTIONS_NULL);
+        }
+
+        pluginLoadFinished(ok, d_gettime_ms() - startTime);
+    }
+
+    void loadFileAsPlugin(const CarlaHostHandle currentHandle, const char* const filename)
+    {
+        const CarlaHostHandle handle = prepareHostHandleForLoad(currentHandle, fPluginWillRunInBridgeMode);
+
+        fLoadingPluginInfo = PluginInfoCache{};
+        fLoadingPluginInfo.name = water::File(filename).getFileName().toRawUTF8();
+        fLoadingFilename = filename;
+
+       #ifndef DISTRHO_OS_WASM
+        // plugin binaries given as files go through the regular plugin loading rules
+        if (! water::File(filename).hasFileExtension("clap;dll;dylib;so;vst;vst3"))
+        {
+            fPluginLoaderThread.loadFile(handle, filename, fReplacingInPlace);
+            startLoadingState();
+            return;
+        }
+       #endif
+
+        const uint32_t startTime = d_gettime_ms();
+        bool ok;
+        {
+            const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
+            ok = carla_load_file(handle, filename);
+        }
+
+        pluginLoadFinished(ok, d_gettime_ms() - startTime);
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    // Whether carla_add_plugin() can be called outside of the UI thread for a plugin type.
+    // VST2, VST3 and CLAP plugins commonly expect, or are required by spec, to be created on the main thread.
+    static bool canLoadPluginInBackground(const PluginType ptype) noexcept
+    {
+        switch (ptype)
+        {
+        case PLUGIN_INTERNAL:
+        case PLUGIN_LADSPA:
+        case PLUGIN_DSSI:
+        case PLUGIN_LV2:
+        case PLUGIN_JSFX:
+        case PLUGIN_SF2:
+        case PLUGIN_SFZ:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void startLoadingState()
+    {
+        fPluginLoadCancelled = false;
+        fPluginGenericUI = nullptr;
+        fDrawingState = kDrawingPluginLoading;
+        repaint();
+    }
+   #endif
+
+    // Remove whatever got loaded, the previous plugin is still running in the other rack or alongside the new one.
+    void discardLoadedPlugin(const bool ok)
+    {
+        const CarlaHostHandle handle = fLoadingHostHandle;
+
+        if (ok && handle != fPlugin->fCarlaHostHandle)
+            carla_remove_all_plugins(handle);
+        else if (ok)
+            carla_remove_plugin(handle, carla_get_current_plugin_count(handle) - 1);
+
+        fPluginLoadCancelled = false;
+        fAddingToChain = false;
+        fReplacingInPlace = false;
+    }
+
+    // Put a successfully loaded plugin in place and keep its details, the carla side of finishing a load.
+    void commitLoadedPlugin()
+    {
+        const CarlaHostHandle handle = fLoadingHostHandle;
+
+        if (handle != fPlugin->fCarlaHostHandle)
+        {
+            fPlugin->startPluginSwap();
+            fPluginSwapPending = true;
+        }
+
+        if (fAddingToChain)
+        {
+            storeChainSlot();
+            fPluginId = carla_get_current_plugin_count(handle) - 1;
+            fAddingToChain = false;
+        }
+
+        if (fReplacingInPlace)
         {
-            ui->values[i] = carla_get_current_parameter_value(handle, fPluginId, ui->parameters[i].rindex);
+            // loaded at the end of the chain, swap it with the previous plugin and remove that one
+            const uint pluginId = carla_get_current_plugin_count(handle) - 1;
+            carla_switch_plugins(handle, fPluginId, pluginId);
+            carla_remove_plugin(handle, pluginId);
+            carla_set_active(handle, fPluginId, true);
+            fReplacingInPlace = false;
+        }
 
-            if (ui->parameters[i].boolean)
-                ui->parameters[i].bvalue = ui->values[i] > ui->parameters[i].min;
+        if (! IldaeilBasePlugin::savePluginState(handle, fPluginId, fPluginDefaultState))
+            fPluginDefaultState.clear();
+
+        const size_t memoryUsage = getProcessMemoryUsage();
+        fPluginMemoryUsage = memoryUsage > fLoadingMemoryUsage ? memoryUsage - fLoadingMemoryUsage : 0;
+
+        if (fLoadingFilename.isNotEmpty())
+        {
+            fPluginFilename = fLoadingFilename;
         }
+        else
+        {
+            fPluginFilename.clear();
+            fCurrentPluginInfo = fLoadingPluginInfo;
+        }
+
+        fPluginRunning = true;
     }
 
-    bool loadPlugin(const CarlaHostHandle handle, const PluginInfoCache& info)
+   #ifndef DISTRHO_OS_WASM
+    // The UI is closing while the loader thread was busy, finish the load without showing anything.
+    void pluginLoadFinishedOnClose(const bool ok)
     {
-        if (fPluginRunning || fPluginId != 0)
+        if (ok && ! fPluginLoadCancelled)
         {
-            hidePluginUI(handle);
-            carla_replace_plugin(handle, fPluginId);
+            commitLoadedPlugin();
+            return;
         }
 
-        carla_set_engine_option(handle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, fPluginWillRunInBridgeMode, nullptr);
+        discardLoadedPlugin(ok);
 
-        const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
+        if (! ok && fLoadingFilename.isNotEmpty())
+            fPluginFilename.clear();
+    }
+   #endif
+
+    // Called on the UI thread once carla is done loading a plugin or file, in this or the loader thread.
+    void pluginLoadFinished(const bool ok, const uint32_t loadTime)
+    {
+        const CarlaHostHandle handle = fLoadingHostHandle;
+
+        if (fPluginLoadCancelled)
+        {
+            discardLoadedPlugin(ok);
 
-        const bool ok = carla_add_plugin(handle,
-                                         info.btype,
-                                         fPluginType,
-                                         info.filename.c_str(),
-                                         info.name.c_str(),
-                                         info.label.c_str(),
-                                         info.uniqueId,
-                                         nullptr,
-                                         PLUGIN_OPTIONS_NULL);
+            d_debug("Discarded %s after cancelled load", fLoadingPluginInfo.name.c_str());
+            fDrawingState = kDrawingPluginList;
+            repaint();
+            return;
+        }
 
         if (ok)
         {
             d_debug("loadeded a plugin with label '%s' and name '%s' %lu",
-                    info.name.c_str(), info.label.c_str(), info.uniqueId);
+                    fLoadingPluginInfo.name.c_str(), fLoadingPluginInfo.label.c_str(), fLoadingPluginInfo.uniqueId);
+
+            d_debug("Loaded %s in %u ms", fLoadingPluginInfo.name.c_str(), loadTime);
+           #ifndef DEBUG
+            (void)loadTime;
+           #endif
+
+            commitLoadedPlugin();
 
-            fPluginRunning = true;
             fPluginGenericUI = nullptr;
-            fPluginFilename.clear();
 
            #ifdef DISTRHO_OS_MAC
-            const bool brokenOffset = fPluginType == PLUGIN_VST2
-                && info.name == "Renoise Redux"
-                && info.uniqueId == d_cconst('R', 'R', 'D', 'X');
+            const bool brokenOffset = fLoadingPluginInfo.ptype == PLUGIN_VST2
+                && fLoadingPluginInfo.name == "Renoise Redux"
+                && fLoadingPluginInfo.uniqueId == d_cconst('R', 'R', 'D', 'X');
             fPluginHostWindow.setOffsetBroken(brokenOffset);
            #endif
 
@@ -635,37 +1793,10 @@ public:
             fPopupError = carla_get_last_error(handle);
             d_stdout("got error: %s", fPopupError.buffer());
             fDrawingState = kDrawingPluginError;
-        }
-
-        repaint();
-        return ok;
-    }
-
-    void loadFileAsPlugin(const CarlaHostHandle handle, const char* const filename)
-    {
-        if (fPluginRunning || fPluginId != 0)
-        {
-            hidePluginUI(handle);
-            carla_replace_plugin(handle, fPluginId);
-        }
-
-        carla_set_engine_option(handle, ENGINE_OPTION_PREFER_PLUGIN_BRIDGES, fPluginWillRunInBridgeMode, nullptr);
-
-        const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
+            discardLoadedPlugin(false);
 
-        if (carla_load_file(handle, filename))
-        {
-            fPluginRunning = true;
-            fPluginGenericUI = nullptr;
-            fPluginFilename = filename;
-            showPluginUI(handle, false);
-        }
-        else
-        {
-            fPopupError = carla_get_last_error(handle);
-            d_stdout("got error: %s", fPopupError.buffer());
-            fDrawingState = kDrawingPluginError;
-            fPluginFilename.clear();
+            if (fLoadingFilename.isNotEmpty())
+                fPluginFilename.clear();
         }
 
         repaint();
@@ -741,10 +1872,46 @@ protected:
         const CarlaHostHandle handle = fPlugin->fCarlaHostHandle;
         DISTRHO_SAFE_ASSERT_RETURN(handle != nullptr,);
 
-        if (fDrawingState == kDrawingPluginGenericUI && fPluginGenericUI != nullptr && fPluginHasOutputParameters)
-        {
-            updatePluginGenericUI(handle);
+        checkPluginSwapFinished();
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        checkLatencyProbeFinished();
+       #endif
+
+        const bool parametersChanged = applyParameterChanges(handle);
+
+        // changes can come from the hosted UI, which we do not get input events for
+        if (parametersChanged)
+            fLastInteractionTime = d_gettime_ms();
+
+        updateHostedUIIdleTimer();
+
+        // plugin discovery only starts once the list is shown, not when opening on an already loaded plugin
+        if (fDrawingState == kDrawingPluginList && ! fPluginDiscoveryStarted)
+            initAndStartRunner();
+
+        if (isDisplayedStateOutdated())
             repaint();
+
+        reportFrameStats();
+
+       #ifndef DISTRHO_OS_WASM
+        if (fDrawingState == kDrawingPluginLoading)
+        {
+            if (fPluginLoaderThread.isFinished())
+            {
+                const uint32_t loadTime = fPluginLoaderThread.getElapsedTime();
+                pluginLoadFinished(fPluginLoaderThread.getResult(), loadTime);
+            }
+
+            return;
+        }
+       #endif
+
+        if (fDrawingState == kDrawingPluginGenericUI && fPluginGenericUI != nullptr)
+        {
+            if (pollOutputParameters(handle) || parametersChanged)
+                repaint();
         }
 
         if (fNextSize.isValid() && fLastSize != fNextSize)
@@ -777,11 +1944,21 @@ protected:
         case kIdleInitPluginAlreadyLoaded:
             fIdleState = kIdleNothing;
             showPluginUI(handle, false);
-            initAndStartRunner();
             break;
 
         case kIdlePluginLoadedFromDSP:
             fIdleState = kIdleNothing;
+            fPluginDefaultState.clear();
+            fPluginMemoryUsage = 0;
+            fOtherSlot = PluginSlot();
+            fChainSlots.clear();
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            for (PluginChainDetails& details : fLayerDetails)
+                details = PluginChainDetails();
+           #endif
+            // might be a different plugin now
+            fPluginGenericUI = nullptr;
+            fPluginId = 0;
             showPluginUI(handle, false);
             break;
 
@@ -792,12 +1969,63 @@ protected:
 
         case kIdleResetPlugin:
             fIdleState = kIdleNothing;
+            if (resetPluginState(handle))
+                break;
             if (fPluginFilename.isNotEmpty())
                 loadFileAsPlugin(handle, fPluginFilename.buffer());
             else
                 loadPlugin(handle, fCurrentPluginInfo);
             break;
 
+        case kIdleCopySlot:
+            fIdleState = kIdleNothing;
+            copyPluginSlot();
+            break;
+
+        case kIdleSwitchSlot:
+            fIdleState = kIdleNothing;
+            switchPluginSlot(handle);
+            break;
+
+        case kIdleSelectChainSlot:
+            fIdleState = kIdleNothing;
+            selectChainSlot(handle, fNextChainSlot);
+            break;
+
+        case kIdleMoveChainSlot:
+            fIdleState = kIdleNothing;
+            moveChainSlot(handle, fNextChainSlot);
+            break;
+
+        case kIdleRemoveChainSlot:
+            fIdleState = kIdleNothing;
+            removeChainSlot(handle);
+            break;
+
+       #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+        case kIdleStartLatencyProbe:
+            fIdleState = kIdleNothing;
+            startLatencyProbe();
+            break;
+       #endif
+
+       #if DISTRHO_PLUGIN_IS_SYNTH
+        case kIdleSelectLayer:
+            fIdleState = kIdleNothing;
+            selectPluginLayer(handle, fNextLayer);
+            break;
+
+        case kIdleAddLayer:
+            fIdleState = kIdleNothing;
+            addPluginLayer(handle);
+            break;
+
+        case kIdleRemoveLayer:
+            fIdleState = kIdleNothing;
+            removePluginLayer(handle);
+            break;
+       #endif
+
         case kIdleOpenFileUI:
             fIdleState = kIdleNothing;
             carla_show_custom_ui(handle, fPluginId, true);
@@ -814,142 +2042,545 @@ protected:
             createOrUpdatePluginGenericUI(handle);
             break;
 
+        case kIdleSuspendEmbedAndShowGenericUI:
+            fIdleState = kIdleNothing;
+            suspendPluginUI(handle);
+            createOrUpdatePluginGenericUI(handle);
+            break;
+
         case kIdleHidePluginUI:
             fIdleState = kIdleNothing;
             hidePluginUI(handle);
             break;
 
         case kIdleGiveIdleToUI:
-            if (fPlugin->fCarlaPluginDescriptor->ui_idle != nullptr)
-                fPlugin->fCarlaPluginDescriptor->ui_idle(fPlugin->fCarlaPluginHandle);
+            if (fHostedUIIdleInterval == 0)
+                giveIdleToPluginUI();
+            break;
+
+        case kIdleChangePluginType:
+            fIdleState = kIdleNothing;
+            if (fPluginRunning)
+                hidePluginUI(handle);
+            if (fNextPluginType == PLUGIN_TYPE_COUNT)
+            {
+                FileBrowserOptions opts;
+                opts.title = "Load from file";
+                openFileBrowser(opts);
+            }
+            else
+            {
+                fPluginSelected = -1;
+                stopRunner();
+                fPluginType = fNextPluginType;
+                initAndStartRunner();
+            }
+            break;
+
+        case kIdleNothing:
+            break;
+        }
+    }
+
+    void giveIdleToPluginUI()
+    {
+        const uint64_t startTime = d_gettime_us();
+
+        if (fPlugin->fCarlaPluginDescriptor->ui_idle != nullptr)
+            fPlugin->fCarlaPluginDescriptor->ui_idle(fPlugin->fCarlaPluginHandle);
+
+        fPluginIsIdling = true;
+        fPluginHostWindow.idle();
+        fPluginIsIdling = false;
+
+        fHostedUIIdleTime += d_gettime_us() - startTime;
+        ++fHostedUIIdleCalls;
+
+        const uint32_t now = d_gettime_ms();
+        const uint32_t elapsed = now - fHostedUIIdleMeasureStart;
+
+        if (elapsed < 1000)
+            return;
+
+        if (elapsed < 2000)
+        {
+            fHostedUIIdleLoad = fHostedUIIdleTime / (elapsed * 1000.0);
+            fHostedUIIdleRate = fHostedUIIdleCalls * 1000 / elapsed;
+        }
+
+        fHostedUIIdleTime = 0;
+        fHostedUIIdleCalls = 0;
+        fHostedUIIdleMeasureStart = now;
+    }
+
+    void hostedUIIdle()
+    {
+        // same conditions as uiIdle, which returns early while loading
+        if (fIdleState == kIdleGiveIdleToUI && fDrawingState != kDrawingPluginLoading)
+            giveIdleToPluginUI();
+    }
+
+    // Pick the hosted UI idle rate from recent interaction and window visibility.
+    // Timers are only changed from here, never from within the timer callback itself.
+    void updateHostedUIIdleTimer()
+    {
+        uint interval = 0;
+
+        if (fIdleState == kIdleGiveIdleToUI && ! fHostedUIIdleTimerFailed)
+        {
+            const uint32_t timeSinceInteraction = d_gettime_ms() - fLastInteractionTime;
+
+            if (! getWindow().isVisible() || timeSinceInteraction >= kHostedUIStaticTime)
+                interval = kHostedUIIdleSlowInterval;
+            else if (timeSinceInteraction < kHostedUIInteractionTime)
+                interval = kHostedUIIdleFastInterval;
+            else
+                interval = kHostedUIIdleInterval;
+        }
+
+        if (interval == fHostedUIIdleInterval)
+            return;
+
+        Window& window(getWindow());
+
+        if (fHostedUIIdleInterval != 0)
+            window.removeIdleCallback(&fHostedUIIdleTimer);
+
+        fHostedUIIdleInterval = 0;
+
+        if (interval == 0)
+            return;
+
+        if (window.addIdleCallback(&fHostedUIIdleTimer, interval))
+        {
+            fHostedUIIdleInterval = interval;
+        }
+        else
+        {
+            // keep using host idle
+            d_stderr("Failed to start hosted UI idle timer, using host idle instead");
+            fHostedUIIdleTimerFailed = true;
+        }
+    }
+
+    bool onMouse(const MouseEvent& ev) override
+    {
+        fLastInteractionTime = d_gettime_ms();
+        return UI::onMouse(ev);
+    }
+
+    bool onMotion(const MotionEvent& ev) override
+    {
+        fLastInteractionTime = d_gettime_ms();
+        return UI::onMotion(ev);
+    }
+
+    bool onScroll(const ScrollEvent& ev) override
+    {
+        fLastInteractionTime = d_gettime_ms();
+        return UI::onScroll(ev);
+    }
+
+    bool onKeyboard(const KeyboardEvent& ev) override
+    {
+        fLastInteractionTime = d_gettime_ms();
+        return UI::onKeyboard(ev);
+    }
+
+    // carla has no bridges for internal plugins, LV2 ones can only run in the same process as carla
+    static bool canRunInBridgeMode(const PluginType ptype) noexcept
+    {
+        return ptype != PLUGIN_INTERNAL && ptype != PLUGIN_LV2;
+    }
+
+    // Format of the plugin list entry currently selected, PLUGIN_NONE if there is none
+    PluginType getSelectedPluginType() const
+    {
+        if (fPluginSelected < 0)
+            return PLUGIN_NONE;
+
+        const std::shared_ptr<const PluginCatalog> catalog(std::atomic_load(&fPluginCatalog));
+
+        if (static_cast<size_t>(fPluginSelected) >= catalog->entries.size())
+            return PLUGIN_NONE;
+
+        return catalog->plugins[catalog->entries[fPluginSelected]].ptype;
+    }
+
+    void loadSelectedPlugin(const CarlaHostHandle handle)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(fPluginSelected >= 0,);
+
+        const std::shared_ptr<const PluginCatalog> catalog(std::atomic_load(&fPluginCatalog));
+        DISTRHO_SAFE_ASSERT_RETURN(static_cast<size_t>(fPluginSelected) < catalog->entries.size(),);
+
+        const PluginInfoCache info(catalog->plugins[catalog->entries[fPluginSelected]]);
+
+        d_stdout("Loading %s...", info.name.c_str());
+
+        loadPlugin(handle, info);
+    }
+
+    void uiFileBrowserSelected(const char* const filename) override
+    {
+        if (fPlugin != nullptr && fPlugin->fCarlaHostHandle != nullptr && filename != nullptr)
+        {
+            if (fNextPluginType == PLUGIN_TYPE_COUNT)
+                loadFileAsPlugin(fPlugin->fCarlaHostHandle, filename);
+            else
+                carla_set_custom_data(fPlugin->fCarlaHostHandle, fPluginId, CUSTOM_DATA_TYPE_PATH, "file", filename);
+        }
+    }
+
+    bool initAndStartRunner()
+    {
+        if (isRunnerActive())
+            stopRunner();
+
+        fRunnerData.init();
+        fPluginDiscoveryStarted = true;
+        return startRunner();
+    }
+
+    bool isDiscoveryThrottled()
+    {
+        if (fPlugin->fProcessLoad.load(std::memory_order_relaxed) < kDiscoveryThrottleLoad)
+        {
+            fRunnerData.throttleTime = 0;
+            return false;
+        }
+
+        const uint32_t now = d_gettime_ms();
+
+        if (fRunnerData.throttleTime == 0)
+        {
+            d_stdout("Audio processing load is high, pausing plugin scan...");
+            fRunnerData.throttleTime = now;
+            return true;
+        }
+
+        if (now - fRunnerData.throttleTime < kDiscoveryThrottleMaxTime)
+            return true;
+
+        // let discovery idle once, then pause again
+        fRunnerData.throttleTime = 0;
+        return false;
+    }
+
+    bool run() override
+    {
+        publishPluginCatalog(false);
+
+        if (isDiscoveryThrottled())
+        {
+            d_msleep(kDiscoveryThrottleSleepTime);
+            return true;
+        }
+
+        if (fRunnerData.needsReinit)
+        {
+            fRunnerData.needsReinit = false;
+            fRunnerData.startTime = d_gettime_ms();
+
+            // discovery tools inherit priority from the thread that starts them
+            setCurrentThreadLowPriority();
+
+            fRunnerData.plugins.clear();
+            fRunnerData.entries.clear();
+            fRunnerData.entryFormats.clear();
+            fRunnerData.entryGroups.clear();
+            ++fRunnerData.generation;
+            publishPluginCatalog(true);
+
+            if (fPluginType == PLUGIN_NONE)
+                initFormatPreference();
+
+            d_stdout("Will scan plugins now...");
 
-            fPluginIsIdling = true;
-            fPluginHostWindow.idle();
-            fPluginIsIdling = false;
-            break;
+            const bool started = startNextPluginTypeDiscovery();
 
-        case kIdleChangePluginType:
-            fIdleState = kIdleNothing;
-            if (fPluginRunning)
-                hidePluginUI(handle);
-            if (fNextPluginType == PLUGIN_TYPE_COUNT)
+            if (fDrawingState == kDrawingLoading)
             {
-                FileBrowserOptions opts;
-                opts.title = "Load from file";
-                openFileBrowser(opts);
+                fDrawingState = kDrawingPluginList;
+                fPluginSearchFirstShow = true;
             }
-            else
+
+            if (! started)
             {
-                fPluginSelected = -1;
-                stopRunner();
-                fPluginType = fNextPluginType;
-                initAndStartRunner();
+                d_stdout("Nothing found!");
+                return false;
             }
-            break;
+        }
 
-        case kIdleNothing:
-            break;
+        if (fRunnerData.cachedIndex < fRunnerData.cachedCount)
+        {
+            // handle a few at a time, so that stopping the runner does not have to wait for all of them
+            for (uint i = 0; i < kInProcessDiscoveryBatchSize && fRunnerData.cachedIndex < fRunnerData.cachedCount; ++i)
+                inProcessPluginDiscovery(fRunnerData.cachedIndex++);
+
+            if (fRunnerData.cachedIndex < fRunnerData.cachedCount)
+                return true;
+        }
+        else
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(fRunnerData.handle != nullptr, false);
+
+            if (carla_plugin_discovery_idle(fRunnerData.handle))
+                return true;
+
+            // stop here
+            carla_plugin_discovery_stop(fRunnerData.handle);
+            fRunnerData.handle = nullptr;
+
+            if (startNextDiscovery())
+                return true;
         }
+
+        if (startNextPluginTypeDiscovery())
+            return true;
+
+        publishPluginCatalog(true);
+
+        d_stdout("Found %lu plugins in %u ms!", (ulong)fRunnerData.plugins.size(), d_gettime_ms() - fRunnerData.startTime);
+        return false;
     }
 
-    void loadSelectedPlugin(const CarlaHostHandle handle)
+    // Copy plugins found so far into a new catalog for the UI thread to use.
+    // Unless forced, only done if there is something new and enough time has passed since the last time.
+    void publishPluginCatalog(const bool force)
     {
-        DISTRHO_SAFE_ASSERT_RETURN(fPluginSelected >= 0,);
+        const uint32_t time = d_gettime_ms();
 
-        PluginInfoCache info;
+        if (! force)
         {
-            const MutexLocker cml(fPluginsMutex);
-            info = fPlugins[fPluginSelected];
+            if (fRunnerData.publishedCount == fRunnerData.plugins.size())
+                return;
+            if (time - fRunnerData.publishTime < kPluginCatalogPublishTime)
+                return;
         }
 
-        d_stdout("Loading %s...", info.name.c_str());
+        fRunnerData.publishedCount = fRunnerData.plugins.size();
+        fRunnerData.publishTime = time;
+
+        const std::shared_ptr<PluginCatalog> catalog(std::make_shared<PluginCatalog>());
+        catalog->generation = fRunnerData.generation;
+        catalog->plugins = fRunnerData.plugins;
+        catalog->entries = fRunnerData.entries;
+        catalog->entryFormats = fRunnerData.entryFormats;
 
-        if (loadPlugin(handle, info))
-            fCurrentPluginInfo = info;
+        std::atomic_store(&fPluginCatalog, std::shared_ptr<const PluginCatalog>(catalog));
+        fPluginCatalogSerial.fetch_add(1, std::memory_order_release);
     }
 
-    void uiFileBrowserSelected(const char* const filename) override
+    // Get the plugin type to scan at a specific index, for the plugin list type currently in use.
+    // Returns PLUGIN_NONE once there are no more types to scan.
+    static PluginType getPluginTypeToScan(const PluginType listType, const uint index) noexcept
     {
-        if (fPlugin != nullptr && fPlugin->fCarlaHostHandle != nullptr && filename != nullptr)
-        {
-            if (fNextPluginType == PLUGIN_TYPE_COUNT)
-                loadFileAsPlugin(fPlugin->fCarlaHostHandle, filename);
-            else
-                carla_set_custom_data(fPlugin->fCarlaHostHandle, fPluginId, CUSTOM_DATA_TYPE_PATH, "file", filename);
-        }
+        static const PluginType allTypes[] = {
+            PLUGIN_INTERNAL,
+           #ifndef DISTRHO_OS_WASM
+            PLUGIN_LADSPA,
+            PLUGIN_DSSI,
+           #endif
+            PLUGIN_LV2,
+           #ifndef DISTRHO_OS_WASM
+            PLUGIN_VST2,
+            PLUGIN_VST3,
+            PLUGIN_CLAP,
+           #endif
+            PLUGIN_JSFX,
+        };
+
+        if (listType != PLUGIN_NONE)
+            return index == 0 ? listType : PLUGIN_NONE;
+
+        return index < ARRAY_SIZE(allTypes) ? allTypes[index] : PLUGIN_NONE;
     }
 
-    bool initAndStartRunner()
+    bool startNextPluginTypeDiscovery()
     {
-        if (isRunnerActive())
-            stopRunner();
+        for (;;)
+        {
+            const PluginType ptype = getPluginTypeToScan(fPluginType, fRunnerData.nextTypeIndex);
 
-        fRunnerData.init();
-        return startRunner();
+            if (ptype == PLUGIN_NONE)
+                return false;
+
+            ++fRunnerData.nextTypeIndex;
+
+            if (startPluginTypeDiscovery(ptype))
+                return true;
+        }
     }
 
-    bool run() override
+    bool startPluginTypeDiscovery(const PluginType ptype)
     {
-        if (fRunnerData.needsReinit)
+        fRunnerData.ptype = ptype;
+        fRunnerData.cachedCount = fRunnerData.cachedIndex = 0;
+
+        if (isInProcessDiscoveryType(ptype))
         {
-            fRunnerData.needsReinit = false;
+            const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
 
-            {
-                const MutexLocker cml(fPluginsMutex);
-                fPlugins.clear();
-            }
+            fRunnerData.cachedCount = carla_get_cached_plugin_count(ptype, IldaeilBasePlugin::getPluginPath(ptype));
+            return fRunnerData.cachedCount != 0;
+        }
 
-            d_stdout("Will scan plugins now...");
+        const String& binaryPath(fPlugin->fBinaryPath);
 
-            const String& binaryPath(fPlugin->fBinaryPath);
+        if (binaryPath.isEmpty())
+            return false;
 
-            if (binaryPath.isNotEmpty())
-            {
-                fBinaryType = BINARY_NATIVE;
+        fBinaryType = BINARY_NATIVE;
 
-                fDiscoveryTool  = binaryPath;
-                fDiscoveryTool += DISTRHO_OS_SEP_STR "carla-discovery-native";
-               #ifdef CARLA_OS_WIN
-                fDiscoveryTool += ".exe";
-               #endif
+        fDiscoveryTool  = binaryPath;
+        fDiscoveryTool += DISTRHO_OS_SEP_STR "carla-discovery-native";
+       #ifdef CARLA_OS_WIN
+        fDiscoveryTool += ".exe";
+       #endif
 
-                fRunnerData.handle = carla_plugin_discovery_start(fDiscoveryTool,
-                                                                  fBinaryType,
-                                                                  fPluginType,
-                                                                  IldaeilBasePlugin::getPluginPath(fPluginType),
-                                                                  _binaryPluginSearchCallback,
-                                                                  _binaryPluginCheckCacheCallback,
-                                                                  this);
+        fRunnerData.handle = carla_plugin_discovery_start(fDiscoveryTool,
+                                                          fBinaryType,
+                                                          ptype,
+                                                          IldaeilBasePlugin::getPluginPath(ptype),
+                                                          _binaryPluginSearchCallback,
+                                                          _binaryPluginCheckCacheCallback,
+                                                          this);
 
-            }
+        return fRunnerData.handle != nullptr || startNextDiscovery();
+    }
 
-            if (fDrawingState == kDrawingLoading)
+    // Format preference for collapsing duplicates in the "All formats" list.
+    // Can be changed with a comma separated list in the ILDAEIL_FORMAT_PREFERENCE environment variable,
+    // formats not mentioned there are ranked after it in the default order.
+    void initFormatPreference()
+    {
+        static const PluginType defaultOrder[] = {
+            PLUGIN_CLAP,
+            PLUGIN_VST3,
+            PLUGIN_LV2,
+            PLUGIN_VST2,
+            PLUGIN_JSFX,
+            PLUGIN_DSSI,
+            PLUGIN_LADSPA,
+            PLUGIN_INTERNAL,
+        };
+
+        uint rank = 0;
+
+        for (uint i = 0; i < PLUGIN_TYPE_COUNT; ++i)
+            fRunnerData.formatRanks[i] = PLUGIN_TYPE_COUNT;
+
+        if (const char* const envPreference = std::getenv("ILDAEIL_FORMAT_PREFERENCE"))
+        {
+            const std::string preference(envPreference);
+
+            for (size_t start = 0, end; start < preference.size(); start = end + 1)
             {
-                fDrawingState = kDrawingPluginList;
-                fPluginSearchFirstShow = true;
+                end = preference.find(',', start);
+                if (end == std::string::npos)
+                    end = preference.size();
+                if (end == start)
+                    continue;
+
+                const PluginType ptype = getPluginTypeFromString(preference.substr(start, end - start).c_str());
+
+                if (ptype != PLUGIN_NONE && fRunnerData.formatRanks[ptype] == PLUGIN_TYPE_COUNT)
+                    fRunnerData.formatRanks[ptype] = rank++;
             }
+        }
+
+        for (const PluginType ptype : defaultOrder)
+        {
+            if (fRunnerData.formatRanks[ptype] == PLUGIN_TYPE_COUNT)
+                fRunnerData.formatRanks[ptype] = rank++;
+        }
+    }
+
+    static bool isInProcessDiscoveryType(const PluginType ptype) noexcept
+    {
+        // metadata for these comes from lilv, ysfx and carla itself, no need to spawn discovery tools
+        switch (ptype)
+        {
+        case PLUGIN_INTERNAL:
+        case PLUGIN_LV2:
+        case PLUGIN_JSFX:
+            return true;
+        default:
+            return false;
+        }
+    }
 
-            if (binaryPath.isEmpty() || (fRunnerData.handle == nullptr && !startNextDiscovery()))
+    // Same path carla-discovery reports for these, the LV2 bundle directory or the JSFX file.
+    // Carla loads them by label, the path is used for searching and prefetching.
+    static std::string getInProcessPluginPath(const PluginType ptype, const char* const label)
+    {
+        switch (ptype)
+        {
+        case PLUGIN_LV2:
+            if (const LilvPlugin* const plugin = Lv2WorldClass::getInstance().getPluginFromURI(label))
             {
-                d_stdout("Nothing found!");
-                return false;
+                if (char* const path = lilv_file_uri_parse(lilv_node_as_uri(lilv_plugin_get_bundle_uri(plugin)),
+                                                           nullptr))
+                {
+                    const std::string bundle(path);
+                    lilv_free(path);
+                    return bundle;
+                }
             }
+            break;
+
+        case PLUGIN_JSFX:
+        {
+            // label is the file path relative to the JSFX directory
+            const water::File file(water::File(IldaeilBasePlugin::getPluginPath(PLUGIN_JSFX)).getChildFile(label));
+
+            if (file.existsAsFile())
+                return file.getFullPathName().toRawUTF8();
+            break;
+        }
+
+        default:
+            break;
         }
 
-        DISTRHO_SAFE_ASSERT_RETURN(fRunnerData.handle != nullptr, false);
+        return std::string();
+    }
 
-        if (carla_plugin_discovery_idle(fRunnerData.handle))
-            return true;
+    void inProcessPluginDiscovery(const uint index)
+    {
+        // carla uses the same lilv world for loading plugins
+        const MutexLocker cml(fPlugin->sPluginInfoLoadMutex);
 
-        // stop here
-        carla_plugin_discovery_stop(fRunnerData.handle);
-        fRunnerData.handle = nullptr;
+        const CarlaCachedPluginInfo* const cinfo = carla_get_cached_plugin_info(fRunnerData.ptype, index);
+        DISTRHO_SAFE_ASSERT_RETURN(cinfo != nullptr,);
 
-        if (startNextDiscovery())
-            return true;
+        if (! cinfo->valid)
+            return;
 
-        d_stdout("Found %lu plugins!", (ulong)fPlugins.size());
-        return false;
+        const std::string filename(getInProcessPluginPath(fRunnerData.ptype, cinfo->label));
+
+        CarlaPluginDiscoveryInfo info = {};
+        info.btype = BINARY_NATIVE;
+        info.ptype = fRunnerData.ptype;
+        info.filename = filename.c_str();
+        info.label = cinfo->label;
+        info.uniqueId = 0;
+        info.metadata.name = cinfo->name;
+        info.metadata.maker = cinfo->maker;
+        info.metadata.category = cinfo->category;
+        info.metadata.hints = cinfo->hints;
+        info.io.audioIns = cinfo->audioIns;
+        info.io.audioOuts = cinfo->audioOuts;
+        info.io.cvIns = cinfo->cvIns;
+        info.io.cvOuts = cinfo->cvOuts;
+        info.io.midiIns = cinfo->midiIns;
+        info.io.midiOuts = cinfo->midiOuts;
+        info.io.parameterIns = cinfo->parameterIns;
+        info.io.parameterOuts = cinfo->parameterOuts;
+
+        // no sha1sum, there is no cache file to write
+        binaryPluginSearchCallback(&info, nullptr);
     }
 
     bool startNextDiscovery()
@@ -959,8 +2590,8 @@ protected:
 
         fRunnerData.handle = carla_plugin_discovery_start(fDiscoveryTool,
                                                           fBinaryType,
-                                                          fPluginType,
-                                                          IldaeilBasePlugin::getPluginPath(fPluginType),
+                                                          fRunnerData.ptype,
+                                                          IldaeilBasePlugin::getPluginPath(fRunnerData.ptype),
                                                           _binaryPluginSearchCallback,
                                                           _binaryPluginCheckCacheCallback,
                                                           this);
@@ -973,7 +2604,7 @@ protected:
 
     bool setNextDiscoveryTool()
     {
-        switch (fPluginType)
+        switch (fRunnerData.ptype)
         {
         case PLUGIN_VST2:
         case PLUGIN_VST3:
@@ -1104,7 +2735,7 @@ protected:
             return;
 
        #if ILDAEIL_STANDALONE
-        if (fPluginType == PLUGIN_INTERNAL)
+        if (info->ptype == PLUGIN_INTERNAL)
         {
             if (std::strcmp(info->label, "audiogain") == 0)
                 return;
@@ -1130,7 +2761,7 @@ protected:
             return;
        #endif
 
-        if (fPluginType == PLUGIN_INTERNAL)
+        if (info->ptype == PLUGIN_INTERNAL)
         {
            #if !ILDAEIL_STANDALONE
             if (std::strcmp(info->label, "audiogain_s") == 0)
@@ -1146,16 +2777,153 @@ protected:
                 return;
         }
 
-        const PluginInfoCache pinfo = {
+        PluginInfoCache pinfo = {
             info->btype,
+            info->ptype,
             info->uniqueId,
             info->filename,
             info->metadata.name,
             info->label,
+            info->metadata.maker,
+            info->io.audioIns,
+            info->io.audioOuts,
+            info->io.midiIns,
+            info->io.midiOuts,
+            {},
         };
 
-        const MutexLocker cml(fPluginsMutex);
-        fPlugins.push_back(pinfo);
+        pinfo.searchKey = foldSearchString(pinfo.name + "\n" + pinfo.maker + "\n" + pinfo.label + "\n" + pinfo.filename);
+
+        addPluginToCatalog(pinfo);
+    }
+
+    void addPluginToCatalog(const PluginInfoCache& pinfo)
+    {
+        const uint index = static_cast<uint>(fRunnerData.plugins.size());
+        const uint32_t format = 1u << pinfo.ptype;
+
+        fRunnerData.plugins.push_back(pinfo);
+
+        if (fPluginType != PLUGIN_NONE)
+        {
+            fRunnerData.entries.push_back(index);
+            fRunnerData.entryFormats.push_back(format);
+            return;
+        }
+
+        // collapse the same plugin available in several formats
+        const std::string key(foldSearchString(pinfo.name + "\n" + pinfo.maker));
+        const std::unordered_map<std::string, uint>::const_iterator it = fRunnerData.entryGroups.find(key);
+
+        if (it == fRunnerData.entryGroups.end())
+        {
+            fRunnerData.entryGroups[key] = static_cast<uint>(fRunnerData.entries.size());
+            fRunnerData.entries.push_back(index);
+            fRunnerData.entryFormats.push_back(format);
+            return;
+        }
+
+        fRunnerData.entryFormats[it->second] |= format;
+
+        uint& entry(fRunnerData.entries[it->second]);
+
+        if (fRunnerData.formatRanks[pinfo.ptype] < fRunnerData.formatRanks[fRunnerData.plugins[entry].ptype])
+        {
+            entry = index;
+            // search results for this entry might no longer be valid
+            ++fRunnerData.generation;
+        }
+    }
+
+    // Warm up the OS file cache for a plugin that is likely to be loaded soon.
+    // The filename is a binary, an LV2 bundle directory or a JSFX file; internal plugins have none.
+    void prefetchPlugin(const PluginInfoCache& info)
+    {
+       #ifndef DISTRHO_OS_WASM
+        if (info.filename.empty())
+            return;
+
+        fPluginPrefetchThread.prefetch(info.filename.c_str());
+       #else
+        // files are already in memory
+        (void)info;
+       #endif
+    }
+
+    // preferred format first, followed by the other ones available
+    static std::string getPluginFormatsText(const PluginType ptype, const uint32_t formats)
+    {
+        std::string text(getPluginTypeAsString(ptype));
+        bool first = true;
+
+        for (uint i = PLUGIN_NONE + 1; i < PLUGIN_TYPE_COUNT; ++i)
+        {
+            if (i == ptype || (formats & (1u << i)) == 0)
+                continue;
+
+            text += first ? " (also " : ", ";
+            text += getPluginTypeAsString(static_cast<PluginType>(i));
+            first = false;
+        }
+
+        if (! first)
+            text += ")";
+
+        return text;
+    }
+
+    // simple ASCII case folding, good enough for plugin names
+    static std::string foldSearchString(std::string str)
+    {
+        for (char& c : str)
+        {
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+        }
+
+        return str;
+    }
+
+    void updatePluginSearchResults(const PluginCatalog& catalog)
+    {
+        const std::string query(fPluginSearchActive ? foldSearchString(fPluginSearchString) : std::string());
+
+        if (fPluginSearchGeneration != catalog.generation)
+        {
+            fPluginSearchGeneration = catalog.generation;
+            fPluginSearchIndexedCount = 0;
+            fPluginSearchResults.clear();
+        }
+        else if (query != fPluginSearchQuery)
+        {
+            // typing more characters only ever narrows down previous results
+            if (! fPluginSearchQuery.empty() && query.find(fPluginSearchQuery) != std::string::npos)
+            {
+                size_t count = 0;
+                for (const uint entry : fPluginSearchResults)
+                {
+                    if (catalog.plugins[catalog.entries[entry]].searchKey.find(query) != std::string::npos)
+                        fPluginSearchResults[count++] = entry;
+                }
+                fPluginSearchResults.resize(count);
+            }
+            else
+            {
+                fPluginSearchIndexedCount = 0;
+                fPluginSearchResults.clear();
+            }
+        }
+
+        fPluginSearchQuery = query;
+
+        // only check plugins added since last time
+        for (size_t i = fPluginSearchIndexedCount; i < catalog.entries.size(); ++i)
+        {
+            if (query.empty() || catalog.plugins[catalog.entries[i]].searchKey.find(query) != std::string::npos)
+                fPluginSearchResults.push_back(static_cast<uint>(i));
+        }
+
+        fPluginSearchIndexedCount = catalog.entries.size();
     }
 
     static void _binaryPluginSearchCallback(void* const ptr,
@@ -1230,27 +2998,193 @@ protected:
                          sha1sum);
             }
         }
-
-        return false;
+
+       #ifndef CARLA_OS_WIN
+        // class ids in moduleinfo.json do not match COM-compatible ones used on Windows, let carla report those
+        if (fRunnerData.ptype == PLUGIN_VST3)
+            return vst3ModuleInfoDiscovery(filename);
+       #endif
+
+        return false;
+    }
+
+    // Fill in plugin info from a VST3 bundle "moduleinfo.json" file, without loading its binary.
+    // Bus layouts are not part of the file, so audio and MIDI IO is guessed from class sub-categories.
+    // Returns false if the file is missing or not conclusive enough, so that the discovery tool is used instead.
+    bool vst3ModuleInfoDiscovery(const char* const filename)
+    {
+        const water::File moduleInfoFile(water::File(filename).getChildFile("Contents/Resources/moduleinfo.json"));
+
+        if (! moduleInfoFile.existsAsFile())
+            return false;
+
+        std::vector<VST3ModuleInfoClass> classes;
+
+        if (! parseVST3ModuleInfo(moduleInfoFile.loadFileAsString().toRawUTF8(), classes))
+        {
+            d_stderr("Failed to parse %s, will load plugin binary instead",
+                     moduleInfoFile.getFullPathName().toRawUTF8());
+            return false;
+        }
+
+        std::vector<CarlaPluginDiscoveryInfo> infos;
+        infos.reserve(classes.size());
+
+        for (const VST3ModuleInfoClass& cinfo : classes)
+        {
+            bool isFx = false, isInstrument = false, isMono = false;
+
+            for (const std::string& subCategory : cinfo.subCategories)
+            {
+                if (subCategory == "Fx")
+                    isFx = true;
+                else if (subCategory == "Instrument")
+                    isInstrument = true;
+                else if (subCategory == "Mono")
+                    isMono = true;
+            }
+
+            if (isFx == isInstrument)
+                return false;
+
+            const uint32_t channels = isMono ? 1 : 2;
+
+            CarlaPluginDiscoveryInfo info = {};
+            info.btype = BINARY_NATIVE;
+            info.ptype = PLUGIN_VST3;
+            info.filename = filename;
+            info.label = cinfo.cid.c_str();
+            info.uniqueId = 0;
+            info.metadata.name = cinfo.name.c_str();
+            info.metadata.maker = cinfo.vendor.c_str();
+            info.metadata.category = getVST3PluginCategory(cinfo.subCategories, isInstrument);
+            info.metadata.hints = isInstrument ? PLUGIN_IS_SYNTH : 0x0;
+            info.io.audioIns = isInstrument ? 0 : channels;
+            info.io.audioOuts = channels;
+            info.io.midiIns = isInstrument ? 1 : 0;
+            infos.push_back(info);
+        }
+
+        // not passing sha1sum, IO is only a guess and must not end up in the cache as if it came from discovery.
+        // moduleinfo.json is read again on the next scan, which is still much cheaper than loading the binary.
+        for (const CarlaPluginDiscoveryInfo& info : infos)
+            binaryPluginSearchCallback(&info, nullptr);
+
+        return true;
+    }
+
+    static PluginCategory getVST3PluginCategory(const std::vector<std::string>& subCategories, const bool isInstrument)
+    {
+        if (isInstrument)
+            return PLUGIN_CATEGORY_SYNTH;
+
+        for (const std::string& subCategory : subCategories)
+        {
+            if (subCategory == "Delay" || subCategory == "Reverb")
+                return PLUGIN_CATEGORY_DELAY;
+            if (subCategory == "Distortion")
+                return PLUGIN_CATEGORY_DISTORTION;
+            if (subCategory == "Dynamics")
+                return PLUGIN_CATEGORY_DYNAMICS;
+            if (subCategory == "EQ")
+                return PLUGIN_CATEGORY_EQ;
+            if (subCategory == "Filter")
+                return PLUGIN_CATEGORY_FILTER;
+            if (subCategory == "Modulation")
+                return PLUGIN_CATEGORY_MODULATOR;
+            if (subCategory == "Analyzer" || subCategory == "Tools" || subCategory == "Restoration")
+                return PLUGIN_CATEGORY_UTILITY;
+        }
+
+        return PLUGIN_CATEGORY_OTHER;
+    }
+
+    static bool _binaryPluginCheckCacheCallback(void* const ptr, const char* const filename, const char* const sha1)
+    {
+        return static_cast<IldaeilUI*>(ptr)->binaryPluginCheckCacheCallback(filename, sha1);
+    }
+
+    uint32_t getPluginLoadingStep() const noexcept
+    {
+       #ifndef DISTRHO_OS_WASM
+        return fPluginLoaderThread.getElapsedTime() / kPluginLoadingRepaintInterval;
+       #else
+        return 0;
+       #endif
+    }
+
+    // Check if something shown on screen changed without an explicit repaint, like new scan results.
+    bool isDisplayedStateOutdated() const
+    {
+        if (fDisplayedState.drawingState != fDrawingState)
+            return true;
+
+        switch (fDrawingState)
+        {
+        case kDrawingLoading:
+        case kDrawingPluginList:
+            return fDisplayedState.catalogSerial != fPluginCatalogSerial.load(std::memory_order_acquire);
+        case kDrawingPluginLoading:
+            return fDisplayedState.loadingStep != getPluginLoadingStep();
+        default:
+            return false;
+        }
     }
 
-    static bool _binaryPluginCheckCacheCallback(void* const ptr, const char* const filename, const char* const sha1)
+    void reportFrameStats()
     {
-        return static_cast<IldaeilUI*>(ptr)->binaryPluginCheckCacheCallback(filename, sha1);
+        const uint32_t now = d_gettime_ms();
+        const uint32_t elapsed = now - fFrameStatsStart;
+
+        if (elapsed < kFrameStatsInterval)
+            return;
+
+        if (fFrameStatsStart != 0)
+            d_debug("Drew %u frames in %u ms, using %.1f ms of UI thread time",
+                    fFrameCount, elapsed, fFrameTime / 1000.0);
+
+        fFrameCount = 0;
+        fFrameTime = 0;
+        fFrameStatsStart = now;
     }
 
     void onImGuiDisplay() override
+    {
+        const uint64_t startTime = d_gettime_us();
+
+        // read before drawing, anything published meanwhile triggers another frame
+        fDisplayedState.catalogSerial = fPluginCatalogSerial.load(std::memory_order_acquire);
+        fDisplayedState.loadingStep = getPluginLoadingStep();
+
+        drawCurrentState();
+
+        fDisplayedState.drawingState = fDrawingState;
+
+        fFrameTime += d_gettime_us() - startTime;
+        ++fFrameCount;
+
+        if (fOpenStartTime != 0)
+        {
+            d_debug("Editor opened in %u ms", d_gettime_ms() - fOpenStartTime);
+            fOpenStartTime = 0;
+        }
+    }
+
+    void drawCurrentState()
     {
         switch (fDrawingState)
         {
         case kDrawingLoading:
             drawLoading();
             break;
+        case kDrawingPluginLoading:
+            drawPluginLoading();
+            break;
         case kDrawingPluginError:
             ImGui::OpenPopup("Plugin Error");
             // call ourselves again with the plugin list
             fDrawingState = kDrawingPluginList;
-            onImGuiDisplay();
+            drawCurrentState();
             break;
         case kDrawingPluginList:
             drawPluginList();
@@ -1307,6 +3241,293 @@ protected:
         ImGui::End();
     }
 
+    void drawSlotButtons()
+    {
+        const uint currentSlot = fPlugin->getCurrentSlot();
+        const bool hasOtherSlot = fPlugin->getOtherSlotHostHandle() != nullptr;
+
+        ImGui::SameLine();
+        ImGui::Spacing();
+
+        for (uint slot = 0; slot < 2; ++slot)
+        {
+            const bool current = slot == currentSlot;
+
+            ImGui::SameLine();
+
+            if (ImGui::RadioButton(slot == 0 ? "A" : "B", current) && ! current)
+                fIdleState = kIdleSwitchSlot;
+
+            if (! ImGui::IsItemHovered())
+                continue;
+
+            if (! current && ! hasOtherSlot)
+            {
+                ImGui::SetTooltip("Empty, switching copies the current plugin");
+                continue;
+            }
+
+            const String& filename(current ? fPluginFilename : fOtherSlot.filename);
+            const std::string name = filename.isNotEmpty()
+                                   ? water::File(filename.buffer()).getFileName().toRawUTF8()
+                                   : (current ? fCurrentPluginInfo : fOtherSlot.info).name;
+            const size_t memoryUsage = current ? fPluginMemoryUsage : fOtherSlot.memoryUsage;
+
+            if (memoryUsage != 0)
+                ImGui::SetTooltip("%s, using about %.1f MiB", name.c_str(), memoryUsage / 1048576.0);
+            else
+                ImGui::SetTooltip("%s", name.c_str());
+        }
+
+        ImGui::SameLine();
+
+        if (ImGui::Button(currentSlot == 0 ? "Copy to B" : "Copy to A"))
+            fIdleState = kIdleCopySlot;
+
+       #if DISTRHO_PLUGIN_NUM_OUTPUTS != 0
+        int crossfadeTime = static_cast<int>(fPlugin->getCrossfadeTime());
+
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(110 * getScaleFactor());
+
+        if (ImGui::SliderInt("##crossfade", &crossfadeTime, 0, kIldaeilMaxCrossfadeTime, "Fade %d ms"))
+            fPlugin->setCrossfadeTime(static_cast<uint>(std::max(0, crossfadeTime)));
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Crossfade time when switching slots or replacing the plugin");
+       #endif
+    }
+
+    void drawChainButtons(const uint chainLength)
+    {
+        const double scaleFactor = getScaleFactor();
+
+        ImGui::SameLine();
+
+        if (ImGui::Button("Add..."))
+        {
+            fAddingToChain = true;
+            fIdleState = kIdleHidePluginUI;
+            fDrawingState = kDrawingPluginList;
+            fNextSize = Size<uint>(kInitialWidth * scaleFactor, kInitialHeight * scaleFactor);
+            fLastSize = Size<uint>();
+            fUpdateGeometryConstraints = true;
+        }
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Add a plugin to the end of the chain");
+
+        if (chainLength <= 1)
+            return;
+
+        const CarlaHostHandle handle = fPlugin->fCarlaHostHandle;
+
+        // no combo here, its popup would open below the top bar and end up behind embed plugin UIs
+        ImGui::SameLine();
+        ImGui::BeginDisabled(fPluginId == 0);
+
+        if (ImGui::ArrowButton("##chainprev", ImGuiDir_Left))
+        {
+            fNextChainSlot = fPluginId - 1;
+            fIdleState = kIdleSelectChainSlot;
+        }
+
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+
+        const bool bypassed = carla_get_internal_parameter_value(handle, fPluginId, PARAMETER_DRYWET) == 0.f;
+        ImGui::AlignTextToFramePadding();
+        ImGui::Text(bypassed ? "%u/%u: %s (bypassed)" : "%u/%u: %s",
+                    fPluginId + 1, chainLength, carla_get_plugin_info(handle, fPluginId)->name);
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Chain of %u plugins, using %.1f%% of the audio deadline",
+                              chainLength, fPlugin->fProcessLoad.load(std::memory_order_relaxed) * 100.f);
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(fPluginId + 1 == chainLength);
+
+        if (ImGui::ArrowButton("##chainnext", ImGuiDir_Right))
+        {
+            fNextChainSlot = fPluginId + 1;
+            fIdleState = kIdleSelectChainSlot;
+        }
+
+        ImGui::EndDisabled();
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(fPluginId == 0);
+
+        if (ImGui::Button("Move <"))
+        {
+            fNextChainSlot = fPluginId - 1;
+            fIdleState = kIdleMoveChainSlot;
+        }
+
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(fPluginId + 1 == chainLength);
+
+        if (ImGui::Button("Move >"))
+        {
+            fNextChainSlot = fPluginId + 1;
+            fIdleState = kIdleMoveChainSlot;
+        }
+
+        ImGui::EndDisabled();
+
+        // bypass through carla dry/wet, which needs matching audio inputs and outputs, other plugins have none.
+        // carla delays the dry signal by the plugin latency, so bypassing does not change the chain latency.
+        if (carla_get_plugin_info(handle, fPluginId)->hints & PLUGIN_CAN_DRYWET)
+        {
+            bool bypass = bypassed;
+
+            ImGui::SameLine();
+
+            if (ImGui::Checkbox("Bypass", &bypass))
+                carla_set_drywet(handle, fPluginId, bypass ? 0.f : 1.f);
+        }
+
+        ImGui::SameLine();
+
+        if (ImGui::Button("Remove"))
+            fIdleState = kIdleRemoveChainSlot;
+    }
+
+   #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+    void drawLatencyProbeButtons()
+    {
+        IldaeilLatencyProbeResult result;
+        const bool hasResult = ! fLatencyProbePending && fPlugin->getLatencyProbeResult(result);
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(fLatencyProbePending);
+
+        if (ImGui::Button(fLatencyProbePending ? "Checking Latency..." : "Check Latency"))
+            fIdleState = kIdleStartLatencyProbe;
+
+        ImGui::EndDisabled();
+
+        if (! hasResult)
+        {
+            if (! fLatencyProbePending && ImGui::IsItemHovered())
+                ImGui::SetTooltip("Feed impulses to a copy of the current plugins, to verify the latency they report");
+            return;
+        }
+
+        if (ImGui::IsItemHovered())
+        {
+            if (result.measured < 0)
+                ImGui::SetTooltip("Reported %u frames, could not measure anything from the plugins", result.reported);
+            else
+                ImGui::SetTooltip("Reported %u frames, measured %i frames (%.1f ms)",
+                                  result.reported, result.measured, result.measured * 1000.0 / getSampleRate());
+        }
+
+        if (result.measured < 0 || static_cast<uint32_t>(result.measured) == result.reported)
+            return;
+
+        bool useMeasured = fPlugin->getUseProbedLatency();
+
+        ImGui::SameLine();
+
+        if (ImGui::Checkbox("Use Measured", &useMeasured))
+            fPlugin->setUseProbedLatency(useMeasured);
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Report %i frames to the host instead, as long as the plugins keep reporting %u",
+                              result.measured, result.reported);
+    }
+   #endif
+
+   #if DISTRHO_PLUGIN_IS_SYNTH
+    void drawLayerButtons()
+    {
+        const double scaleFactor = getScaleFactor();
+        const uint layerCount = fPlugin->getLayerCount();
+        const uint layer = fPlugin->getSelectedLayer();
+
+        ImGui::SameLine();
+        ImGui::Spacing();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(layer == 0);
+
+        if (ImGui::ArrowButton("##layerprev", ImGuiDir_Left))
+        {
+            fNextLayer = layer - 1;
+            fIdleState = kIdleSelectLayer;
+        }
+
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::AlignTextToFramePadding();
+        ImGui::Text("Layer %u/%u", layer + 1, layerCount);
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Layers play the same notes in parallel, using %.1f%% of the audio deadline",
+                              fPlugin->fProcessLoad.load(std::memory_order_relaxed) * 100.f);
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(layer + 1 == layerCount);
+
+        if (ImGui::ArrowButton("##layernext", ImGuiDir_Right))
+        {
+            fNextLayer = layer + 1;
+            fIdleState = kIdleSelectLayer;
+        }
+
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(layerCount == kIldaeilMaxLayers);
+
+        if (ImGui::Button("Add Layer"))
+            fIdleState = kIdleAddLayer;
+
+        ImGui::EndDisabled();
+
+        // splits only matter once there is more than 1 layer
+        if (layerCount == 1)
+            return;
+
+        IldaeilLayerSplit split(fPlugin->getLayerSplit(layer));
+        int keys[2] = { split.lowKey, split.highKey };
+        int velocities[2] = { split.lowVelocity, split.highVelocity };
+        bool changed = false;
+
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(110 * scaleFactor);
+        changed |= ImGui::DragIntRange2("##layerkeys", &keys[0], &keys[1], 0.25f, 0, 127, "Key %d", "%d");
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Range of notes played by this layer");
+
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(110 * scaleFactor);
+        changed |= ImGui::DragIntRange2("##layervelocities", &velocities[0], &velocities[1], 0.25f, 1, 127,
+                                        "Vel %d", "%d");
+
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Range of note velocities played by this layer");
+
+        if (changed)
+        {
+            split.lowKey = keys[0];
+            split.highKey = keys[1];
+            split.lowVelocity = velocities[0];
+            split.highVelocity = velocities[1];
+            fPlugin->setLayerSplit(layer, split);
+        }
+
+        if (layer + 1 == layerCount)
+        {
+            ImGui::SameLine();
+
+            if (ImGui::Button("Remove Layer"))
+                fIdleState = kIdleRemoveLayer;
+        }
+    }
+   #endif
+
     void drawTopBar()
     {
         const double scaleFactor = getScaleFactor();
@@ -1332,6 +3553,7 @@ protected:
         {
             if (ImGui::Button("Pick Another..."))
             {
+                fAddingToChain = false;
                 fIdleState = kIdleHidePluginUI;
                 fDrawingState = kDrawingPluginList;
                 fNextSize = Size<uint>(kInitialWidth * scaleFactor, kInitialHeight * scaleFactor);
@@ -1344,6 +3566,26 @@ protected:
             if (ImGui::Button("Reset"))
                 fIdleState = kIdleResetPlugin;
 
+            const uint chainLength = getChainLength();
+
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            drawLayerButtons();
+
+            // A/B slots compare single plugins, chains only get A/B through a saved state
+            if (chainLength == 1 && fPlugin->getSelectedLayer() == 0)
+                drawSlotButtons();
+           #else
+            // A/B slots compare single plugins, chains only get A/B through a saved state
+            if (chainLength == 1)
+                drawSlotButtons();
+           #endif
+
+            drawChainButtons(chainLength);
+
+           #if DISTRHO_PLUGIN_NUM_INPUTS != 0
+            drawLatencyProbeButtons();
+           #endif
+
             if (fDrawingState == kDrawingPluginGenericUI)
             {
                 if (fPluginHasCustomUI)
@@ -1352,6 +3594,10 @@ protected:
 
                     if (ImGui::Button("Show Custom GUI"))
                         fIdleState = kIdleShowCustomUI;
+
+                    if (fPluginEmbedUISuspended && fEmbedUIMemoryUsage != 0 && ImGui::IsItemHovered())
+                        ImGui::SetTooltip("Kept open in the background, using about %.1f MiB",
+                                          fEmbedUIMemoryUsage / 1048576.0);
                 }
 
                 if (fPluginHasFileOpen)
@@ -1385,7 +3631,23 @@ protected:
                 ImGui::SameLine();
 
                 if (ImGui::Button("Show Generic GUI"))
-                    fIdleState = kIdleHideEmbedAndShowGenericUI;
+                    fIdleState = fPlugin->getKeepEmbedUI() ? kIdleSuspendEmbedAndShowGenericUI
+                                                           : kIdleHideEmbedAndShowGenericUI;
+
+                if (ImGui::IsItemHovered() && fHostedUIIdleRate != 0)
+                    ImGui::SetTooltip("Plugin UI idle at %u Hz, using %.2f%% of the UI thread",
+                                      fHostedUIIdleRate, fHostedUIIdleLoad * 100.f);
+
+                bool keepEmbedUI = fPlugin->getKeepEmbedUI();
+
+                ImGui::SameLine();
+
+                if (ImGui::Checkbox("Keep Open", &keepEmbedUI))
+                    fPlugin->setKeepEmbedUI(keepEmbedUI);
+
+                if (ImGui::IsItemHovered())
+                    ImGui::SetTooltip("Keep the plugin UI open in the background while showing the generic one, "
+                                      "so switching back is faster at the cost of memory");
             }
 
            #if ILDAEIL_STANDALONE
@@ -1487,10 +3749,9 @@ protected:
 
         const int pflags = ImGuiWindowFlags_NoSavedSettings
                          | ImGuiWindowFlags_NoResize
-                         | ImGuiWindowFlags_NoCollapse
-                         | ImGuiWindowFlags_AlwaysAutoResize;
+                         | ImGuiWindowFlags_NoCollapse;
 
-        if (ImGui::Begin(ui->title, nullptr, pflags))
+        if (ImGui::Begin(ui->getString(ui->title), nullptr, pflags))
         {
             const CarlaHostHandle handle = fPlugin->fCarlaHostHandle;
 
@@ -1511,82 +3772,129 @@ protected:
                 }
             }
 
-            if (ui->presetCount != 0)
+            if (! ui->presetStrings.empty())
             {
                 ImGui::Text("Preset:");
                 ImGui::SameLine();
 
-                if (ImGui::Combo("##presets", &ui->currentPreset, ui->presetStrings, ui->presetCount))
+                if (ImGui::Combo("##presets", &ui->currentPreset,
+                                 ui->presetStrings.data(), static_cast<int>(ui->presetStrings.size())))
                 {
-                    PluginGenericUI::Preset& preset(ui->presets[ui->currentPreset]);
-
-                    carla_set_program(handle, fPluginId, preset.index);
+                    carla_set_program(handle, fPluginId, ui->presetIndexes[ui->currentPreset]);
                 }
             }
 
-            const char* groupName = "";
-
-            for (uint32_t i=0; i < ui->parameterCount; ++i)
+            if (ui->parameters.size() > kGenericUISearchMinParameters)
             {
-                PluginGenericUI::Parameter& param(ui->parameters[i]);
+                ImGui::SetNextItemWidth(-1);
+                ImGui::InputTextWithHint("##parametersearch", "Search parameters...",
+                                         fParameterSearchString, sizeof(fParameterSearchString)-1,
+                                         ImGuiInputTextFlags_AutoSelectAll);
+            }
 
-                if (param.group != nullptr && std::strcmp(param.group, groupName) != 0)
-                {
-                    groupName = param.group;
-                    ImGui::SeparatorText(groupName);
-                }
+            updatePluginGenericUIRows(ui);
 
-                if (param.readonly)
-                {
-                    ImGui::BeginDisabled();
-                    ImGui::SliderFloat(param.name, &ui->values[i], param.min, param.max, param.printformat,
-                                       ImGuiSliderFlags_NoInput | (param.log ? ImGuiSliderFlags_Logarithmic : 0x0));
-                    ImGui::EndDisabled();
-                    continue;
-                }
+            if (ImGui::BeginChild("##parameters"))
+            {
+                const bool searching = ! ui->rowsQuery.empty();
 
-                if (param.boolean)
+                ImGuiListClipper clipper;
+                clipper.Begin(static_cast<int>(ui->rows.size()), ImGui::GetFrameHeightWithSpacing());
+
+                while (clipper.Step())
                 {
-                    if (ImGui::Checkbox(param.name, &ui->parameters[i].bvalue))
+                    for (int r = clipper.DisplayStart; r < clipper.DisplayEnd; ++r)
                     {
-                        if (ImGui::IsItemActivated())
-                        {
-                            carla_set_parameter_touch(handle, fPluginId, param.rindex, true);
-                            // editParameter(0, true);
-                        }
+                        const uint32_t row = ui->rows[r];
+
+                        ImGui::PushID(static_cast<int>(row));
 
-                        ui->values[i] = ui->parameters[i].bvalue ? ui->parameters[i].max : ui->parameters[i].min;
-                        carla_set_parameter_value(handle, fPluginId, param.rindex, ui->values[i]);
-                        // setParameterValue(0, ui->values[i]);
+                        if (row & PluginGenericUI::kSectionRow)
+                            drawGenericUISection(ui, row & ~PluginGenericUI::kSectionRow, searching);
+                        else
+                            drawGenericUIParameter(handle, ui, row);
+
+                        ImGui::PopID();
                     }
                 }
-                else
-                {
-                    const bool ret = param.log
-                                   ? ImGui::SliderFloat(param.name, &ui->values[i], param.min, param.max, param.printformat, ImGuiSliderFlags_Logarithmic)
-                                   : ImGui::SliderFloat(param.name, &ui->values[i], param.min, param.max, param.printformat);
-                    if (ret)
-                    {
-                        if (ImGui::IsItemActivated())
-                        {
-                            carla_set_parameter_touch(handle, fPluginId, param.rindex, true);
-                            // editParameter(0, true);
-                        }
+            }
 
-                        carla_set_parameter_value(handle, fPluginId, param.rindex, ui->values[i]);
-                        // setParameterValue(0, ui->values[i]);
-                    }
+            ImGui::EndChild();
+        }
+
+        ImGui::End();
+    }
+
+    void drawGenericUISection(PluginGenericUI* const ui, const uint index, const bool searching)
+    {
+        PluginGenericUI::Section& section(ui->sections[index]);
+
+        ImGui::SetNextItemOpen(section.open || searching);
+
+        const bool open = ImGui::CollapsingHeader(ui->getString(section.name));
+
+        if (! searching && open != section.open)
+        {
+            section.open = open;
+            ui->rowsNeedUpdate = true;
+        }
+    }
+
+    void drawGenericUIParameter(const CarlaHostHandle handle, PluginGenericUI* const ui, const uint i)
+    {
+        loadPluginGenericUIParameter(handle, ui, i);
+
+        PluginGenericUI::Parameter& param(ui->parameters[i]);
+        const char* const name = ui->getString(param.name);
+        const char* const printformat = ui->getString(param.printformat);
+
+        if (param.readonly)
+        {
+            ImGui::BeginDisabled();
+            ImGui::SliderFloat(name, &ui->values[i], param.min, param.max, printformat,
+                               ImGuiSliderFlags_NoInput | (param.log ? ImGuiSliderFlags_Logarithmic : 0x0));
+            ImGui::EndDisabled();
+            return;
+        }
+
+        if (param.boolean)
+        {
+            if (ImGui::Checkbox(name, &param.bvalue))
+            {
+                if (ImGui::IsItemActivated())
+                {
+                    carla_set_parameter_touch(handle, fPluginId, param.rindex, true);
+                    // editParameter(0, true);
                 }
 
-                if (ImGui::IsItemDeactivated())
+                ui->values[i] = param.bvalue ? param.max : param.min;
+                carla_set_parameter_value(handle, fPluginId, param.rindex, ui->values[i]);
+                // setParameterValue(0, ui->values[i]);
+            }
+        }
+        else
+        {
+            const bool ret = param.log
+                           ? ImGui::SliderFloat(name, &ui->values[i], param.min, param.max, printformat, ImGuiSliderFlags_Logarithmic)
+                           : ImGui::SliderFloat(name, &ui->values[i], param.min, param.max, printformat);
+            if (ret)
+            {
+                if (ImGui::IsItemActivated())
                 {
-                    carla_set_parameter_touch(handle, fPluginId, param.rindex, false);
-                    // editParameter(0, false);
+                    carla_set_parameter_touch(handle, fPluginId, param.rindex, true);
+                    // editParameter(0, true);
                 }
+
+                carla_set_parameter_value(handle, fPluginId, param.rindex, ui->values[i]);
+                // setParameterValue(0, ui->values[i]);
             }
         }
 
-        ImGui::End();
+        if (ImGui::IsItemDeactivated())
+        {
+            carla_set_parameter_touch(handle, fPluginId, param.rindex, false);
+            // editParameter(0, false);
+        }
     }
 
     void drawLoading()
@@ -1602,6 +3910,37 @@ protected:
         ImGui::End();
     }
 
+    void drawPluginLoading()
+    {
+        setupMainWindowPos();
+
+        constexpr const int plflags = ImGuiWindowFlags_NoSavedSettings
+                                    | ImGuiWindowFlags_NoDecoration;
+
+        if (ImGui::Begin("Plugin List", nullptr, plflags))
+        {
+           #ifndef DISTRHO_OS_WASM
+            const uint32_t elapsed = fPluginLoaderThread.getElapsedTime();
+           #else
+            const uint32_t elapsed = 0;
+           #endif
+
+            ImGui::Text("Loading %s... %.1f s", fLoadingPluginInfo.name.c_str(), elapsed / 1000.0);
+
+            // carla does not report progress, just show that something is happening
+            ImGui::ProgressBar(static_cast<float>(elapsed % 2000) / 2000.f, ImVec2(-1.0f, 0.0f), "");
+
+            ImGui::BeginDisabled(fPluginLoadCancelled);
+
+            if (ImGui::Button(fPluginLoadCancelled ? "Cancelling..." : "Cancel"))
+                fPluginLoadCancelled = true;
+
+            ImGui::EndDisabled();
+        }
+
+        ImGui::End();
+    }
+
     void drawPluginList()
     {
         static const char* pluginTypes[] = {
@@ -1617,6 +3956,7 @@ protected:
             getPluginTypeAsString(PLUGIN_CLAP),
            #endif
             getPluginTypeAsString(PLUGIN_JSFX),
+            "All formats",
             "Load from file..."
         };
 
@@ -1667,9 +4007,11 @@ protected:
             switch (fPluginType)
             {
            #ifdef DISTRHO_OS_WASM
+            case PLUGIN_NONE: current = 3; break;
             case PLUGIN_JSFX: current = 2; break;
             case PLUGIN_LV2: current = 1; break;
            #else
+            case PLUGIN_NONE: current = 8; break;
             case PLUGIN_JSFX: current = 7; break;
             case PLUGIN_CLAP: current = 6; break;
             case PLUGIN_VST3: current = 5; break;
@@ -1690,7 +4032,8 @@ protected:
                 case 0: fNextPluginType = PLUGIN_INTERNAL; break;
                 case 1: fNextPluginType = PLUGIN_LV2; break;
                 case 2: fNextPluginType = PLUGIN_JSFX; break;
-                case 3: fNextPluginType = PLUGIN_TYPE_COUNT; break;
+                case 3: fNextPluginType = PLUGIN_NONE; break;
+                case 4: fNextPluginType = PLUGIN_TYPE_COUNT; break;
                #else
                 case 0: fNextPluginType = PLUGIN_INTERNAL; break;
                 case 1: fNextPluginType = PLUGIN_LADSPA; break;
@@ -1700,7 +4043,8 @@ protected:
                 case 5: fNextPluginType = PLUGIN_VST3; break;
                 case 6: fNextPluginType = PLUGIN_CLAP; break;
                 case 7: fNextPluginType = PLUGIN_JSFX; break;
-                case 8: fNextPluginType = PLUGIN_TYPE_COUNT; break;
+                case 8: fNextPluginType = PLUGIN_NONE; break;
+                case 9: fNextPluginType = PLUGIN_TYPE_COUNT; break;
                #endif
                 }
             }
@@ -1710,8 +4054,8 @@ protected:
             if (ImGui::Button("Load Plugin"))
                 fIdleState = kIdleLoadSelectedPlugin;
 
-            // xx cardinal
-            if (fPluginType != PLUGIN_INTERNAL /*&& module->canUseBridges*/)
+            // the "All formats" list mixes formats, go by the entry about to be loaded
+            if (canRunInBridgeMode(fPluginSelected >= 0 ? getSelectedPluginType() : fPluginType))
             {
                 ImGui::SameLine();
                 ImGui::Checkbox("Run in bridge mode", &fPluginWillRunInBridgeMode);
@@ -1724,17 +4068,29 @@ protected:
                 ImGui::SameLine();
 
                 if (ImGui::Button("Cancel"))
+                {
+                    fAddingToChain = false;
                     fIdleState = kIdleShowCustomUI;
+                }
             }
 
+           #if DISTRHO_PLUGIN_IS_SYNTH
+            // an empty layer shows the list, switching layers must be possible from here too
+            drawLayerButtons();
+           #endif
+
             if (ImGui::BeginChild("pluginlistwindow"))
             {
-                if (ImGui::BeginTable("pluginlist", 2, ImGuiTableFlags_NoSavedSettings))
+                if (ImGui::BeginTable("pluginlist", fPluginType == PLUGIN_NONE ? 3 : 2, ImGuiTableFlags_NoSavedSettings))
                 {
-                    const char* const search = fPluginSearchActive && fPluginSearchString[0] != '\0' ? fPluginSearchString : nullptr;
-
                     switch (fPluginType)
                     {
+                    case PLUGIN_NONE:
+                        ImGui::TableSetupColumn("Name");
+                        ImGui::TableSetupColumn("Maker");
+                        ImGui::TableSetupColumn("Format");
+                        ImGui::TableHeadersRow();
+                        break;
                     case PLUGIN_INTERNAL:
                     case PLUGIN_AU:
                         ImGui::TableSetupColumn("Name");
@@ -1753,45 +4109,71 @@ protected:
                         break;
                     }
 
-                    const MutexLocker cml(fPluginsMutex);
-
-                    for (uint i=0; i<fPlugins.size(); ++i)
-                    {
-                        const PluginInfoCache& info(fPlugins[i]);
+                    // keep a reference, the scanner thread might publish a new catalog meanwhile
+                    const std::shared_ptr<const PluginCatalog> catalog(std::atomic_load(&fPluginCatalog));
 
-                        if (search != nullptr && ildaeil::strcasestr(info.name.c_str(), search) == nullptr)
-                            continue;
+                    updatePluginSearchResults(*catalog);
 
-                        bool selected = fPluginSelected >= 0 && static_cast<uint>(fPluginSelected) == i;
+                    // only submit rows that are actually visible
+                    ImGuiListClipper clipper;
+                    clipper.Begin(static_cast<int>(fPluginSearchResults.size()));
 
-                        switch (fPluginType)
+                    while (clipper.Step())
+                    {
+                        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
                         {
-                        case PLUGIN_INTERNAL:
-                        case PLUGIN_AU:
-                            ImGui::TableNextRow();
-                            ImGui::TableSetColumnIndex(0);
-                            ImGui::Selectable(info.name.c_str(), &selected);
-                            ImGui::TableSetColumnIndex(1);
-                            ImGui::Selectable(info.label.c_str(), &selected);
-                            break;
-                        case PLUGIN_LV2:
-                            ImGui::TableNextRow();
-                            ImGui::TableSetColumnIndex(0);
-                            ImGui::Selectable(info.name.c_str(), &selected);
-                            ImGui::TableSetColumnIndex(1);
-                            ImGui::Selectable(info.label.c_str(), &selected);
-                            break;
-                        default:
-                            ImGui::TableNextRow();
-                            ImGui::TableSetColumnIndex(0);
-                            ImGui::Selectable(info.name.c_str(), &selected);
-                            ImGui::TableSetColumnIndex(1);
-                            ImGui::Selectable(info.filename.c_str(), &selected);
-                            break;
+                            const uint i = fPluginSearchResults[row];
+                            const PluginInfoCache& info(catalog->plugins[catalog->entries[i]]);
+
+                            bool selected = fPluginSelected >= 0 && static_cast<uint>(fPluginSelected) == i;
+
+                            // makers and formats repeat across rows, keep their ids unique
+                            ImGui::PushID(static_cast<int>(i));
+
+                            switch (fPluginType)
+                            {
+                            case PLUGIN_NONE:
+                                ImGui::TableNextRow();
+                                ImGui::TableSetColumnIndex(0);
+                                ImGui::Selectable(info.name.c_str(), &selected);
+                                ImGui::TableSetColumnIndex(1);
+                                ImGui::Selectable(info.maker.c_str(), &selected);
+                                ImGui::TableSetColumnIndex(2);
+                                ImGui::Selectable(getPluginFormatsText(info.ptype, catalog->entryFormats[i]).c_str(),
+                                                  &selected);
+                                break;
+                            case PLUGIN_INTERNAL:
+                            case PLUGIN_AU:
+                                ImGui::TableNextRow();
+                                ImGui::TableSetColumnIndex(0);
+                                ImGui::Selectable(info.name.c_str(), &selected);
+                                ImGui::TableSetColumnIndex(1);
+                                ImGui::Selectable(info.label.c_str(), &selected);
+                                break;
+                            case PLUGIN_LV2:
+                                ImGui::TableNextRow();
+                                ImGui::TableSetColumnIndex(0);
+                                ImGui::Selectable(info.name.c_str(), &selected);
+                                ImGui::TableSetColumnIndex(1);
+                                ImGui::Selectable(info.label.c_str(), &selected);
+                                break;
+                            default:
+                                ImGui::TableNextRow();
+                                ImGui::TableSetColumnIndex(0);
+                                ImGui::Selectable(info.name.c_str(), &selected);
+                                ImGui::TableSetColumnIndex(1);
+                                ImGui::Selectable(info.filename.c_str(), &selected);
+                                break;
+                            }
+
+                            ImGui::PopID();
+
+                            if (selected && fPluginSelected != static_cast<int>(i))
+                            {
+                                fPluginSelected = i;
+                                prefetchPlugin(info);
+                            }
                         }
-
-                        if (selected)
-                            fPluginSelected = i;
                     }
 
                     ImGui::EndTable();
@@ -1837,11 +4219,11 @@ void ildaeilProjectLoadedFromDSP(void* const ui)
     static_cast<IldaeilUI*>(ui)->projectLoadedFromDSP();
 }
 
-void ildaeilParameterChangeForUI(void* const ui, const uint32_t index, const float value)
+void ildaeilParameterChangeForUI(void* const ui, const uint queue, const uint32_t index, const float value)
 {
     DISTRHO_SAFE_ASSERT_RETURN(ui != nullptr,);
 
-    static_cast<IldaeilUI*>(ui)->changeParameterFromDSP(index, value);
+    static_cast<IldaeilUI*>(ui)->changeParameterFromDSP(queue, index, value);
 }
 
 void ildaeilResizeUI(void* const ui, const uint32_t width, const uint32_t height)
@@ -1870,7 +4252,8 @@ const char* ildaeilOpenFileForUI(void* const ui, const bool isDir, const char* c
 
 UI* createUI()
 {
-    return new IldaeilUI();
+    // taken before the base class creates the ImGui context and fonts, so those are included
+    return new IldaeilUI(d_gettime_ms());
 }
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,110 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Impulse train and cross-correlation used to measure the actual latency of a rack.
+// After some silence, a few impulses are fed kMaxLatencyTime apart. The output following each impulse is summed up,
+// which cross-correlates it with the impulse train, and the lag with the strongest response is the latency.
+// Always covers the same amount of audio, so the cost stays bounded regardless of what is being measured.
+
+struct LatencyProbeCorrelation {
+    static constexpr const uint kPrerollTime = 100;
+    static constexpr const uint kMaxLatencyTime = 1000;
+    static constexpr const uint kImpulseCount = 4;
+    // weaker responses (per impulse) are taken as silence
+    static constexpr const float kMinResponse = 0.001f;
+
+    // in frames, valid after reset
+    uint32_t preroll = 0;
+    uint32_t window = 0;
+    uint32_t end = 0;
+
+    void reset(const double sampleRate)
+    {
+        preroll = static_cast<uint32_t>(sampleRate * kPrerollTime / 1000.0);
+        window = static_cast<uint32_t>(sampleRate * kMaxLatencyTime / 1000.0);
+        end = preroll + window * kImpulseCount;
+
+        correlation.assign(window * 2, 0.f);
+    }
+
+    // Fill a stereo block starting at offset with the probe signal.
+    void fillInput(float* const* const inputs, const uint32_t offset, const uint32_t frames) const
+    {
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const uint32_t pos = offset + i;
+
+            inputs[0][i] = inputs[1][i] = pos >= preroll && pos < end && (pos - preroll) % window == 0 ? 1.f : 0.f;
+        }
+    }
+
+    // Accumulate a stereo output block starting at offset, anything outside the impulse train is ignored.
+    void addOutput(const float* const* const outputs, const uint32_t offset, const uint32_t frames)
+    {
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const uint32_t pos = offset + i;
+
+            if (pos < preroll || pos >= end)
+                continue;
+
+            const uint32_t lag = (pos - preroll) % window;
+            correlation[lag] += outputs[0][i];
+            correlation[window + lag] += outputs[1][i];
+        }
+    }
+
+    // Lag with the strongest response in frames, or -1 if nothing came out.
+    // Uses absolute values, so plugins inverting the polarity are measured too.
+    int32_t getMeasured() const noexcept
+    {
+        float peak = kMinResponse * kImpulseCount;
+        int32_t measured = -1;
+
+        for (uint32_t lag = 0; lag < window; ++lag)
+        {
+            const float response = std::abs(correlation[lag]) + std::abs(correlation[window + lag]);
+
+            if (response > peak)
+            {
+                peak = response;
+                measured = static_cast<int32_t>(lag);
+            }
+        }
+
+        return measured;
+    }
+
+private:
+    // left channel followed by the right one
+    std::vector<float> correlation;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -31,6 +31,7 @@ FILES_DSP = \
 FILES_UI = \
 	IldaeilUI.cpp \
 	../Common/PluginHostWindow.cpp \
+	../Common/VST3ModuleInfo.cpp \
 	../../dpf-widgets/opengl/DearImGui.cpp
 
 ifeq ($(STANDALONE)$(WINDOWS),truetrue)
@@ -0,0 +1,67 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "CarlaHost.h"
+#include "extra/String.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Details of hosted plugins that carla does not keep, like what they were loaded from.
+// Used by the UI, kept by the plugin side next to the racks so they survive the UI being closed.
+
+struct PluginInfoCache {
+    BinaryType btype;
+    PluginType ptype;
+    uint64_t uniqueId;
+    std::string filename;
+    std::string name;
+    std::string label;
+    std::string maker;
+    uint32_t audioIns, audioOuts;
+    uint32_t midiIns, midiOuts;
+    // case-folded name, maker, label and filename, for quick searching
+    std::string searchKey;
+};
+
+struct PluginSlot {
+    PluginInfoCache info;
+    // file loaded as a plugin, reloaded from it instead of info
+    String filename;
+    // plugin state right after loading, restored on reset instead of a full reload
+    String defaultState;
+    // estimated memory used by the plugin, 0 if unknown
+    size_t memoryUsage = 0;
+};
+
+// A rack in chain mode, holding several plugins processed in series
+struct PluginChainDetails {
+    // indexed by plugin id
+    std::vector<PluginSlot> chainSlots;
+    // the one shown in the UI
+    uint pluginId = 0;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,96 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Model behind the generic UI of a hosted plugin.
+// Built and used by the UI, kept by the plugin side while the UI is closed.
+
+struct PluginGenericUI {
+    // all strings are offsets into this single buffer, offset 0 is an empty string
+    std::vector<char> strings;
+    uint32_t title = 0;
+
+    struct Parameter {
+        uint32_t name = 0;
+        uint32_t printformat = 0;
+        uint32_t searchKey = 0;
+        uint32_t rindex = 0;
+        bool boolean = false;
+        bool bvalue = false;
+        bool log = false;
+        bool readonly = false;
+        // ranges and value are only fetched once the parameter is first shown
+        bool loaded = false;
+        float min = 0.f;
+        float max = 1.f;
+    };
+    std::vector<Parameter> parameters;
+    std::vector<float> values;
+
+    // consecutive parameters of the same group, named ones can be collapsed
+    struct Section {
+        uint32_t name = 0;
+        uint first = 0;
+        uint count = 0;
+        bool open = true;
+    };
+    std::vector<Section> sections;
+
+    // what gets drawn, either parameter indexes or kSectionRow plus section index
+    static constexpr const uint32_t kSectionRow = 0x80000000;
+    std::vector<uint32_t> rows;
+    std::string rowsQuery;
+    bool rowsNeedUpdate = true;
+
+    // indexes into parameters, for the ones that need polling
+    std::vector<uint> outputParameters;
+
+    // carla parameter index to index into parameters, kInvalidSlot for disabled ones
+    static constexpr const uint kInvalidSlot = UINT32_MAX;
+    std::vector<uint> rindexToSlot;
+
+    std::vector<uint32_t> presetIndexes;
+    std::vector<const char*> presetStrings;
+    int currentPreset = -1;
+
+    uint32_t addString(const char* const str)
+    {
+        const uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.insert(strings.end(), str, str + std::strlen(str) + 1);
+        return offset;
+    }
+
+    const char* getString(const uint32_t offset) const noexcept
+    {
+        return strings.data() + offset;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -63,12 +63,19 @@ struct PluginHostWindow::PrivateData
    #else
     ::Display* display = XOpenDisplay(nullptr);
     ::Window pluginWindow = 0;
+    // plugin window geometry, kept up to date through events on the parent window
+    int pluginX = 0;
+    int pluginY = 0;
+    int pluginWidth = 0;
+    int pluginHeight = 0;
+    bool selectingInput = false;
    #endif
 
     uint xOffset = 0;
     uint yOffset = 0;
     bool brokenOffsetFactor = false;
     bool lookingForChildren = false;
+    bool suspended = false;
 
     PrivateData(void* const wh, Callbacks* const cbs)
         : windowHandle(wh),
@@ -98,6 +105,7 @@ struct PluginHostWindow::PrivateData
     void restart()
     {
         lookingForChildren = true;
+        suspended = false;
 
        #if defined(DISTRHO_OS_HAIKU)
        #elif defined(DISTRHO_OS_MAC)
@@ -107,14 +115,132 @@ struct PluginHostWindow::PrivateData
         pluginWindow = nullptr;
        #else
         pluginWindow = 0;
+        pluginWidth = pluginHeight = 0;
 
+        if (display == nullptr)
+            return;
+
+        // children of the parent window are tracked through events instead of polling
+        if (! selectingInput)
+        {
+            XSelectInput(display, (::Window)windowHandle, SubstructureNotifyMask);
+            selectingInput = true;
+        }
+
+        // discard anything about previous children
+        XSync(display, True);
+       #endif
+    }
+
+   #ifdef ILDAEIL_X11
+    void setPluginWindow(const ::Window window, const int x, const int y, const int width, const int height)
+    {
+        pluginWindow = window;
+        pluginX = x;
+        pluginY = y;
+        pluginWidth = width;
+        pluginHeight = height;
+
+        if (width > 1 && height > 1)
+            return;
+
+        // some plugins only set their size through hints
+        XSizeHints sizeHints;
+        memset(&sizeHints, 0, sizeof(sizeHints));
+
+        pthread_mutex_lock(&gErrorMutex);
+        const XErrorHandler oldErrorHandler = XSetErrorHandler(ildaeilErrorHandler);
+        gErrorTriggered = false;
+
+        long supplied = 0;
+        if (XGetWMNormalHints(display, window, &sizeHints, &supplied) && ! gErrorTriggered)
+        {
+            if (sizeHints.flags & PSize)
+            {
+                pluginWidth = sizeHints.width;
+                pluginHeight = sizeHints.height;
+            }
+            else if (sizeHints.flags & PBaseSize)
+            {
+                pluginWidth = sizeHints.base_width;
+                pluginHeight = sizeHints.base_height;
+            }
+        }
+
+        XSetErrorHandler(oldErrorHandler);
+        pthread_mutex_unlock(&gErrorMutex);
+    }
+
+    void processEvents()
+    {
+        // XPending does not do a round trip, this is free if nothing happened
         for (XEvent event; XPending(display) > 0;)
+        {
             XNextEvent(display, &event);
-       #endif
+
+            switch (event.type)
+            {
+            case CreateNotify:
+                // pick last child, needed for NTK based UIs which do not delete/remove previous windows.
+                if (lookingForChildren && event.xcreatewindow.parent == (::Window)windowHandle)
+                    setPluginWindow(event.xcreatewindow.window,
+                                    event.xcreatewindow.x, event.xcreatewindow.y,
+                                    event.xcreatewindow.width, event.xcreatewindow.height);
+                break;
+
+            case ReparentNotify:
+                if (event.xreparent.parent == (::Window)windowHandle)
+                {
+                    if (! lookingForChildren)
+                        break;
+
+                    // the event does not include size, this case is rare enough to query it
+                    XWindowAttributes attrs;
+                    memset(&attrs, 0, sizeof(attrs));
+
+                    pthread_mutex_lock(&gErrorMutex);
+                    const XErrorHandler oldErrorHandler = XSetErrorHandler(ildaeilErrorHandler);
+                    gErrorTriggered = false;
+
+                    if (! XGetWindowAttributes(display, event.xreparent.window, &attrs) || gErrorTriggered)
+                        attrs.width = attrs.height = 0;
+
+                    XSetErrorHandler(oldErrorHandler);
+                    pthread_mutex_unlock(&gErrorMutex);
+
+                    setPluginWindow(event.xreparent.window, event.xreparent.x, event.xreparent.y,
+                                    attrs.width, attrs.height);
+                }
+                else if (event.xreparent.window == pluginWindow)
+                {
+                    // moved out of our window
+                    pluginWindow = 0;
+                }
+                break;
+
+            case ConfigureNotify:
+                if (event.xconfigure.window == pluginWindow)
+                {
+                    pluginX = event.xconfigure.x;
+                    pluginY = event.xconfigure.y;
+                    pluginWidth = event.xconfigure.width;
+                    pluginHeight = event.xconfigure.height;
+                }
+                break;
+
+            case DestroyNotify:
+                if (event.xdestroywindow.window == pluginWindow)
+                    pluginWindow = 0;
+                break;
+            }
+        }
     }
+   #endif
 
     bool hide()
     {
+        suspended = false;
+
        #if defined(DISTRHO_OS_HAIKU)
        #elif defined(DISTRHO_OS_MAC)
         if (pluginView != nullptr)
@@ -136,7 +262,7 @@ struct PluginHostWindow::PrivateData
         if (pluginWindow != 0)
         {
             XUnmapWindow(display, pluginWindow);
-            XSync(display, True);
+            XFlush(display);
             pluginWindow = 0;
             return true;
         }
@@ -144,8 +270,72 @@ struct PluginHostWindow::PrivateData
         return false;
     }
 
+    bool suspend()
+    {
+       #if defined(DISTRHO_OS_HAIKU)
+       #elif defined(DISTRHO_OS_MAC)
+        if (pluginView != nullptr && ! suspended)
+        {
+            [pluginView setHidden:YES];
+            suspended = true;
+            return true;
+        }
+       #elif defined(DISTRHO_OS_WASM)
+       #elif defined(DISTRHO_OS_WINDOWS)
+        if (pluginWindow != nullptr && ! suspended)
+        {
+            ShowWindow(pluginWindow, SW_HIDE);
+            suspended = true;
+            return true;
+        }
+       #else
+        if (pluginWindow != 0 && ! suspended)
+        {
+            XUnmapWindow(display, pluginWindow);
+            XFlush(display);
+            suspended = true;
+            return true;
+        }
+       #endif
+        return false;
+    }
+
+    bool resume()
+    {
+        if (! suspended)
+            return false;
+
+        suspended = false;
+
+       #if defined(DISTRHO_OS_HAIKU)
+       #elif defined(DISTRHO_OS_MAC)
+        [pluginView setHidden:NO];
+       #elif defined(DISTRHO_OS_WASM)
+       #elif defined(DISTRHO_OS_WINDOWS)
+        ShowWindow(pluginWindow, SW_SHOWNA);
+       #else
+        XMapWindow(display, pluginWindow);
+        XFlush(display);
+       #endif
+
+        // report size and position again on next idle
+        lookingForChildren = true;
+        return true;
+    }
+
     void idle()
     {
+       #ifdef ILDAEIL_X11
+        if (display == nullptr)
+            return;
+
+        processEvents();
+       #endif
+
+        // nothing to track while unmapped
+        if (suspended)
+            return;
+
         if (lookingForChildren)
         {
            #if defined(DISTRHO_OS_HAIKU)
@@ -169,22 +359,7 @@ struct PluginHostWindow::PrivateData
             if (pluginWindow == nullptr)
                 pluginWindow = FindWindowExA((::HWND)windowHandle, nullptr, nullptr, nullptr);
            #else
-            if (display != nullptr && pluginWindow == 0)
-            {
-                ::Window rootWindow, parentWindow;
-                ::Window* childWindows = nullptr;
-                uint numChildren = 0;
-
-                XQueryTree(display, (::Window)windowHandle, &rootWindow, &parentWindow, &childWindows, &numChildren);
-
-                if (numChildren > 0 && childWindows != nullptr)
-                {
-                    // pick last child, needed for NTK based UIs which do not delete/remove previous windows.
-                    //sadly this breaks ildaeil-within-ildaeil recursion.. :(
-                    pluginWindow = childWindows[numChildren - 1];
-                    XFree(childWindows);
-                }
-            }
+            // X11 children are found through CreateNotify and ReparentNotify events
            #endif
         }
 
@@ -236,60 +411,24 @@ struct PluginHostWindow::PrivateData
             }
         }
        #else
-        for (XEvent event; XPending(display) > 0;)
-            XNextEvent(display, &event);
-
-        if (pluginWindow != 0)
+        if (pluginWindow != 0 && pluginWidth > 1 && pluginHeight > 1)
         {
-            int width = 0;
-            int height = 0;
-
-            XWindowAttributes attrs;
-            memset(&attrs, 0, sizeof(attrs));
-
-            pthread_mutex_lock(&gErrorMutex);
-            const XErrorHandler oldErrorHandler = XSetErrorHandler(ildaeilErrorHandler);
-            gErrorTriggered = false;
-
-            if (XGetWindowAttributes(display, pluginWindow, &attrs) && ! gErrorTriggered)
-            {
-                width = attrs.width;
-                height = attrs.height;
-            }
-
-            XSetErrorHandler(oldErrorHandler);
-            pthread_mutex_unlock(&gErrorMutex);
-
-            if (width == 0 && height == 0)
+            if (lookingForChildren)
             {
-                XSizeHints sizeHints;
-                memset(&sizeHints, 0, sizeof(sizeHints));
-
-                if (XGetNormalHints(display, pluginWindow, &sizeHints))
-                {
-                    if (sizeHints.flags & PSize)
-                    {
-                        width = sizeHints.width;
-                        height = sizeHints.height;
-                    }
-                    else if (sizeHints.flags & PBaseSize)
-                    {
-                        width = sizeHints.base_width;
-                        height = sizeHints.base_height;
-                    }
-                }
+                d_stdout("child window bounds %i %i | offset %u %u", pluginWidth, pluginHeight, xOffset, yOffset);
+                lookingForChildren = false;
             }
 
-            if (lookingForChildren)
-                d_stdout("child window bounds %i %i | offset %u %u", width, height, xOffset, yOffset);
-
-            if (width > 1 && height > 1)
+            // the resulting ConfigureNotify updates our position
+            if (pluginX != static_cast<int>(xOffset) || pluginY != static_cast<int>(yOffset))
             {
-                lookingForChildren = false;
                 XMoveWindow(display, pluginWindow, xOffset, yOffset);
-                XSync(display, True);
-                pluginWindowCallbacks->pluginWindowResized(width, height);
+                XFlush(display);
+                pluginX = xOffset;
+                pluginY = yOffset;
             }
+
+            pluginWindowCallbacks->pluginWindowResized(pluginWidth, pluginHeight);
         }
        #endif
     }
@@ -341,6 +480,16 @@ bool PluginHostWindow::hide()
     return pData->hide();
 }
 
+bool PluginHostWindow::suspend()
+{
+    return pData->suspend();
+}
+
+bool PluginHostWindow::resume()
+{
+    return pData->resume();
+}
+
 void PluginHostWindow::idle()
 {
     pData->idle();
@@ -37,6 +37,9 @@ public:
 
     void restart();
     bool hide();
+    // unmap the plugin window but keep track of it, so it can be shown again without re-embedding
+    bool suspend();
+    bool resume();
     void idle();
     void setOffset(uint x, uint y);
     void setOffsetBroken(bool brokenOffsetFactor);
@@ -0,0 +1,496 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "VST3ModuleInfo.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// minimal JSON5-ish reader, just enough for moduleinfo.json files
+
+struct JsonValue {
+    enum Type {
+        kTypeNull,
+        kTypeBool,
+        kTypeNumber,
+        kTypeString,
+        kTypeArray,
+        kTypeObject,
+    } type = kTypeNull;
+
+    std::string string;
+    // array items, or object values matching `keys`
+    std::vector<JsonValue> items;
+    std::vector<std::string> keys;
+
+    const JsonValue* get(const char* const key) const
+    {
+        if (type != kTypeObject)
+            return nullptr;
+
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (keys[i] == key)
+                return &items[i];
+        }
+
+        return nullptr;
+    }
+
+    const char* getString(const char* const key) const
+    {
+        const JsonValue* const value = get(key);
+        return value != nullptr && value->type == kTypeString ? value->string.c_str() : nullptr;
+    }
+};
+
+class JsonParser
+{
+    static constexpr const uint kMaxDepth = 32;
+
+    const char* p;
+    uint depth = 0;
+
+public:
+    explicit JsonParser(const char* const json)
+        : p(json) {}
+
+    bool parse(JsonValue& value)
+    {
+        // skip UTF-8 BOM
+        if (std::strncmp(p, "\xEF\xBB\xBF", 3) == 0)
+            p += 3;
+
+        if (! parseValue(value))
+            return false;
+
+        skipSpace();
+        return *p == '\0';
+    }
+
+private:
+    void skipSpace()
+    {
+        for (;;)
+        {
+            switch (*p)
+            {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                ++p;
+                break;
+            case '/':
+                if (p[1] == '/')
+                {
+                    p += 2;
+                    while (*p != '\0' && *p != '\n')
+                        ++p;
+                    break;
+                }
+                if (p[1] == '*')
+                {
+                    p += 2;
+                    while (*p != '\0' && std::strncmp(p, "*/", 2) != 0)
+                        ++p;
+                    if (*p != '\0')
+                        p += 2;
+                    break;
+                }
+                return;
+            default:
+                return;
+            }
+        }
+    }
+
+    bool parseValue(JsonValue& value)
+    {
+        skipSpace();
+
+        switch (*p)
+        {
+        case '{':
+            return parseObject(value);
+        case '[':
+            return parseArray(value);
+        case '"':
+        case '\'':
+            value.type = JsonValue::kTypeString;
+            return parseString(value.string);
+        default:
+            break;
+        }
+
+        if (std::strncmp(p, "true", 4) == 0 || std::strncmp(p, "null", 4) == 0)
+        {
+            value.type = *p == 't' ? JsonValue::kTypeBool : JsonValue::kTypeNull;
+            p += 4;
+            return true;
+        }
+
+        if (std::strncmp(p, "false", 5) == 0)
+        {
+            value.type = JsonValue::kTypeBool;
+            p += 5;
+            return true;
+        }
+
+        // numbers are not needed, just validate and skip them
+        char* end = nullptr;
+        std::strtod(p, &end);
+        if (end == p)
+        {
+            // strtod does not take hexadecimal numbers with a sign, which JSON5 allows
+            std::strtol(p, &end, 0);
+            if (end == p)
+                return false;
+        }
+
+        value.type = JsonValue::kTypeNumber;
+        value.string.assign(p, end - p);
+        p = end;
+        return true;
+    }
+
+    bool parseObject(JsonValue& value)
+    {
+        if (++depth > kMaxDepth)
+            return false;
+
+        value.type = JsonValue::kTypeObject;
+        ++p;
+
+        for (;;)
+        {
+            skipSpace();
+
+            if (*p == '}')
+                break;
+
+            std::string key;
+            if (*p == '"' || *p == '\'')
+            {
+                if (! parseString(key))
+                    return false;
+            }
+            else
+            {
+                // JSON5 unquoted identifier
+                const char* const start = p;
+                while (*p == '_' || *p == '$' || (*p >= '0' && *p <= '9')
+                       || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))
+                    ++p;
+                if (p == start)
+                    return false;
+                key.assign(start, p - start);
+            }
+
+            skipSpace();
+            if (*p++ != ':')
+                return false;
+
+            value.keys.push_back(key);
+            value.items.push_back(JsonValue());
+
+            if (! parseValue(value.items.back()))
+                return false;
+
+            skipSpace();
+            if (*p == ',')
+                ++p;
+            else if (*p != '}')
+                return false;
+        }
+
+        ++p;
+        --depth;
+        return true;
+    }
+
+    bool parseArray(JsonValue& value)
+    {
+        if (++depth > kMaxDepth)
+            return false;
+
+        value.type = JsonValue::kTypeArray;
+        ++p;
+
+        for (;;)
+        {
+            skipSpace();
+
+            if (*p == ']')
+                break;
+
+            value.items.push_back(JsonValue());
+
+            if (! parseValue(value.items.back()))
+                return false;
+
+            skipSpace();
+            if (*p == ',')
+                ++p;
+            else if (*p != ']')
+                return false;
+        }
+
+        ++p;
+        --depth;
+        return true;
+    }
+
+    bool parseString(std::string& string)
+    {
+        const char quote = *p++;
+
+        for (;;)
+        {
+            const char c = *p++;
+
+            if (c == quote)
+                return true;
+
+            switch (c)
+            {
+            case '\0':
+                return false;
+            case '\\':
+                break;
+            default:
+                string += c;
+                continue;
+            }
+
+            switch (const char e = *p++)
+            {
+            case '\0':
+                return false;
+            case 'b':
+                string += '\b';
+                break;
+            case 'f':
+                string += '\f';
+                break;
+            case 'n':
+                string += '\n';
+                break;
+            case 'r':
+                string += '\r';
+                break;
+            case 't':
+                string += '\t';
+                break;
+            case 'u':
+                if (! parseUnicodeEscape(string))
+                    return false;
+                break;
+            case '\r':
+            case '\n':
+                // JSON5 line continuation
+                if (e == '\r' && *p == '\n')
+                    ++p;
+                break;
+            default:
+                string += e;
+                break;
+            }
+        }
+    }
+
+    bool parseHex4(uint& codepoint)
+    {
+        codepoint = 0;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            const char c = *p++;
+            codepoint <<= 4;
+
+            if (c >= '0' && c <= '9')
+                codepoint |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                codepoint |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                codepoint |= c - 'A' + 10;
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    bool parseUnicodeEscape(std::string& string)
+    {
+        uint codepoint;
+        if (! parseHex4(codepoint))
+            return false;
+
+        // surrogate pair
+        if (codepoint >= 0xD800 && codepoint <= 0xDBFF && p[0] == '\\' && p[1] == 'u')
+        {
+            p += 2;
+
+            uint low;
+            if (! parseHex4(low) || low < 0xDC00 || low > 0xDFFF)
+                return false;
+
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        if (codepoint < 0x80)
+        {
+            string += static_cast<char>(codepoint);
+        }
+        else if (codepoint < 0x800)
+        {
+            string += static_cast<char>(0xC0 | (codepoint >> 6));
+            string += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else if (codepoint < 0x10000)
+        {
+            string += static_cast<char>(0xE0 | (codepoint >> 12));
+            string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            string += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else
+        {
+            string += static_cast<char>(0xF0 | (codepoint >> 18));
+            string += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            string += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            string += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+
+        return true;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+// moduleinfo.json stores class ids as 32 hex characters in tuid byte order,
+// carla labels them as 4 big-endian 32bit values
+static bool formatClassId(const char* const cid, std::string& label)
+{
+    if (std::strlen(cid) != 32)
+        return false;
+
+    uint32_t values[4] = {};
+
+    for (int i = 0; i < 32; ++i)
+    {
+        const char c = cid[i];
+        uint32_t nibble;
+
+        if (c >= '0' && c <= '9')
+            nibble = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            nibble = c - 'A' + 10;
+        else
+            return false;
+
+        values[i / 8] = (values[i / 8] << 4) | nibble;
+    }
+
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "0x%08X,0x%08X,0x%08X,0x%08X", values[0], values[1], values[2], values[3]);
+    label = buf;
+    return true;
+}
+
+bool parseVST3ModuleInfo(const char* const json, std::vector<VST3ModuleInfoClass>& classes)
+{
+    DISTRHO_SAFE_ASSERT_RETURN(json != nullptr, false);
+
+    JsonValue root;
+    if (! JsonParser(json).parse(root))
+        return false;
+
+    const JsonValue* const jclasses = root.get("Classes");
+    if (jclasses == nullptr || jclasses->type != JsonValue::kTypeArray)
+        return false;
+
+    // class vendor is optional, fallback to the factory one
+    const char* factoryVendor = nullptr;
+    if (const JsonValue* const factoryInfo = root.get("Factory Info"))
+        factoryVendor = factoryInfo->getString("Vendor");
+
+    classes.clear();
+
+    for (const JsonValue& jclass : jclasses->items)
+    {
+        const char* const category = jclass.getString("Category");
+        if (category == nullptr || std::strcmp(category, "Audio Module Class") != 0)
+            continue;
+
+        const char* const cid = jclass.getString("CID");
+        const char* const name = jclass.getString("Name");
+        if (cid == nullptr || name == nullptr)
+            return false;
+
+        VST3ModuleInfoClass info;
+        if (! formatClassId(cid, info.cid))
+            return false;
+
+        info.name = name;
+
+        if (const char* const vendor = jclass.getString("Vendor"))
+            info.vendor = vendor;
+        else if (factoryVendor != nullptr)
+            info.vendor = factoryVendor;
+
+        if (const JsonValue* const subCategories = jclass.get("Sub Categories"))
+        {
+            // older files have a single '|' separated string
+            if (subCategories->type == JsonValue::kTypeArray)
+            {
+                for (const JsonValue& subCategory : subCategories->items)
+                {
+                    if (subCategory.type == JsonValue::kTypeString)
+                        info.subCategories.push_back(subCategory.string);
+                }
+            }
+            else if (subCategories->type == JsonValue::kTypeString)
+            {
+                const std::string& s(subCategories->string);
+                for (size_t start = 0, end; start <= s.size(); start = end + 1)
+                {
+                    end = s.find('|', start);
+                    if (end == std::string::npos)
+                        end = s.size();
+                    if (end != start)
+                        info.subCategories.push_back(s.substr(start, end - start));
+                }
+            }
+        }
+
+        classes.push_back(info);
+    }
+
+    return !classes.empty();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,46 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <string>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Static class information from a VST3 bundle "Contents/Resources/moduleinfo.json" file.
+// Only "Audio Module Class" entries are reported, the ones a host can instantiate as plugins.
+
+struct VST3ModuleInfoClass {
+    // class id formatted the same way as carla uses for VST3 plugin labels
+    std::string cid;
+    std::string name;
+    std::string vendor;
+    std::vector<std::string> subCategories;
+};
+
+// Parse the contents of a moduleinfo.json file.
+// The format is JSON5-like, trailing commas and comments are accepted.
+// Returns false if the data is malformed or has no valid audio classes.
+bool parseVST3ModuleInfo(const char* json, std::vector<VST3ModuleInfoClass>& classes);
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
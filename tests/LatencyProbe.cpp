@@ -0,0 +1,158 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "LatencyProbe.hpp"
+
+#include <cstdio>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static int sFailures = 0;
+
+#define CHECK(cond)                                                 \
+    if (! (cond)) {                                                 \
+        std::fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++sFailures;                                                \
+    }
+
+// Stands in for a rack: a short FIR filter whose taps are applied after a fixed delay, processed in blocks.
+struct SyntheticRack {
+    uint32_t delay;
+    std::vector<float> taps;
+    // past input of each channel, as a ring buffer
+    std::vector<float> history[2];
+    size_t pos = 0;
+
+    SyntheticRack(const uint32_t d, const std::vector<float>& t)
+        : delay(d),
+          taps(t)
+    {
+        history[0].assign(delay + taps.size(), 0.f);
+        history[1].assign(delay + taps.size(), 0.f);
+    }
+
+    void process(const float* const* const inputs, float* const* const outputs, const uint32_t frames)
+    {
+        const size_t size = history[0].size();
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            for (uint c = 0; c < 2; ++c)
+            {
+                history[c][pos] = inputs[c][i];
+
+                float out = 0.f;
+                for (size_t t = 0; t < taps.size(); ++t)
+                    out += taps[t] * history[c][(pos + size - delay - t) % size];
+
+                outputs[c][i] = out;
+            }
+
+            pos = (pos + 1) % size;
+        }
+    }
+};
+
+// Run the probe the same way IldaeilLatencyProbe does, always in full blocks.
+static int32_t measure(SyntheticRack& rack, const double sampleRate, const uint32_t bufferSize)
+{
+    LatencyProbeCorrelation correlation;
+    correlation.reset(sampleRate);
+
+    std::vector<float> buffer(bufferSize * 4);
+    float* inputs[2] = { buffer.data(), buffer.data() + bufferSize };
+    float* outputs[2] = { buffer.data() + bufferSize * 2, buffer.data() + bufferSize * 3 };
+
+    for (uint32_t offset = 0; offset < correlation.end; offset += bufferSize)
+    {
+        correlation.fillInput(inputs, offset, bufferSize);
+        rack.process(inputs, outputs, bufferSize);
+        correlation.addOutput(outputs, offset, bufferSize);
+    }
+
+    return correlation.getMeasured();
+}
+
+static void testPlainDelay()
+{
+    SyntheticRack none(0, { 1.f });
+    CHECK(measure(none, 48000.0, 256) == 0);
+
+    SyntheticRack small(64, { 1.f });
+    CHECK(measure(small, 48000.0, 256) == 64);
+
+    // larger than a block and not a multiple of it
+    SyntheticRack large(1234, { 1.f });
+    CHECK(measure(large, 48000.0, 256) == 1234);
+
+    // odd block size, not lined up with the impulses
+    SyntheticRack odd(777, { 1.f });
+    CHECK(measure(odd, 44100.0, 100) == 777);
+}
+
+static void testFilteredResponse()
+{
+    // inverted polarity
+    SyntheticRack inverted(300, { -0.5f });
+    CHECK(measure(inverted, 48000.0, 128) == 300);
+
+    // the strongest tap wins, like a linear phase filter centered after a few frames
+    SyntheticRack filter(200, { 0.1f, 0.25f, 0.5f, 0.25f, 0.1f });
+    CHECK(measure(filter, 48000.0, 128) == 202);
+}
+
+static void testNoResponse()
+{
+    SyntheticRack silent(0, { 0.f });
+    CHECK(measure(silent, 48000.0, 256) == -1);
+
+    // below the silence threshold
+    SyntheticRack quiet(10, { LatencyProbeCorrelation::kMinResponse * 0.25f });
+    CHECK(measure(quiet, 48000.0, 256) == -1);
+}
+
+static void testWrapAround()
+{
+    // delays past the measuring window wrap around, they cannot be told apart from short ones
+    SyntheticRack late(48000 + 10, { 1.f });
+    CHECK(measure(late, 48000.0, 256) == 10);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testPlainDelay();
+    testFilteredResponse();
+    testNoResponse();
+    testWrapAround();
+
+    if (sFailures != 0)
+    {
+        std::fprintf(stderr, "%i checks failed\n", sFailures);
+        return 1;
+    }
+
+    std::printf("All LatencyProbe checks passed\n");
+    return 0;
+}
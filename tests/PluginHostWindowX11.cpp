@@ -0,0 +1,182 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// Counts the X requests PluginHostWindow makes while tracking an embedded plugin window.
+// Needs an X server, run it with "xvfb-run -a" where there is none; skipped if no display can be opened.
+
+#include "PluginHostWindow.hpp"
+
+#include <X11/Xlib.h>
+
+#include <cstdio>
+#include <dlfcn.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// PluginHostWindow opens its own display connection, catch it so its request serial can be read
+
+static Display* sLastOpenedDisplay = nullptr;
+
+extern "C" Display* XOpenDisplay(const char* const name)
+{
+    typedef Display* (*XOpenDisplayFunc)(const char*);
+    static const XOpenDisplayFunc realXOpenDisplay = (XOpenDisplayFunc)dlsym(RTLD_NEXT, "XOpenDisplay");
+
+    sLastOpenedDisplay = realXOpenDisplay(name);
+    return sLastOpenedDisplay;
+}
+
+START_NAMESPACE_DGL
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static int sFailures = 0;
+
+#define CHECK(cond)                                                 \
+    if (! (cond)) {                                                 \
+        std::fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++sFailures;                                                \
+    }
+
+struct TestCallbacks : PluginHostWindow::Callbacks {
+    uint width = 0;
+    uint height = 0;
+
+    void pluginWindowResized(const uint w, const uint h) override
+    {
+        width = w;
+        height = h;
+    }
+};
+
+// Give idle to the host window until it reports the expected size, events reach it asynchronously.
+static bool waitForSize(PluginHostWindow& host, TestCallbacks& callbacks, const uint width, const uint height)
+{
+    for (int i = 0; i < 200; ++i)
+    {
+        host.idle();
+
+        if (callbacks.width == width && callbacks.height == height)
+            return true;
+
+        usleep(5000);
+    }
+
+    return false;
+}
+
+static void testRequests(Display* const display)
+{
+    const ::Window parent = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, 640, 480, 0, 0, 0);
+    XMapWindow(display, parent);
+    XSync(display, False);
+
+    TestCallbacks callbacks;
+    PluginHostWindow host((void*)parent, &callbacks);
+    Display* const hostDisplay = sLastOpenedDisplay;
+    CHECK(hostDisplay != nullptr && hostDisplay != display);
+
+    if (hostDisplay == nullptr || hostDisplay == display)
+        return;
+
+    host.restart();
+
+    // a plugin embedding its window, from its own connection
+    const ::Window child = XCreateSimpleWindow(display, parent, 0, 0, 300, 200, 0, 0, 0);
+    XMapWindow(display, child);
+    XSync(display, False);
+
+    CHECK(waitForSize(host, callbacks, 300, 200));
+
+    // nothing changed, no requests at all
+    const unsigned long serial = XNextRequest(hostDisplay);
+
+    for (int i = 0; i < 100; ++i)
+        host.idle();
+
+    CHECK(XNextRequest(hostDisplay) == serial);
+
+    // the plugin resizing itself is picked up from events, still without requests
+    XResizeWindow(display, child, 400, 300);
+    XSync(display, False);
+
+    CHECK(waitForSize(host, callbacks, 400, 300));
+    CHECK(XNextRequest(hostDisplay) == serial);
+
+    // a new offset takes a single move, and only once
+    host.setOffset(10, 20);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        host.idle();
+        usleep(100);
+    }
+
+    CHECK(XNextRequest(hostDisplay) == serial + 1);
+
+    XWindowAttributes attrs;
+    XGetWindowAttributes(display, child, &attrs);
+    CHECK(attrs.x == 10 && attrs.y == 20);
+
+    // the plugin window going away stops the size reports
+    XDestroyWindow(display, child);
+    XSync(display, False);
+
+    for (int i = 0; i < 20; ++i)
+    {
+        host.idle();
+        usleep(5000);
+    }
+
+    callbacks.width = callbacks.height = 0;
+    host.idle();
+    CHECK(callbacks.width == 0 && callbacks.height == 0);
+    CHECK(XNextRequest(hostDisplay) == serial + 1);
+
+    XDestroyWindow(display, parent);
+    XSync(display, False);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DGL
+
+int main()
+{
+    USE_NAMESPACE_DGL;
+
+    Display* const display = XOpenDisplay(nullptr);
+
+    if (display == nullptr)
+    {
+        std::printf("No X display available, skipping PluginHostWindow checks\n");
+        return 0;
+    }
+
+    testRequests(display);
+
+    XCloseDisplay(display);
+
+    if (sFailures != 0)
+    {
+        std::fprintf(stderr, "%i checks failed\n", sFailures);
+        return 1;
+    }
+
+    std::printf("All PluginHostWindow checks passed\n");
+    return 0;
+}
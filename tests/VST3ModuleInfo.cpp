@@ -0,0 +1,144 @@
+/*
+ * DISTRHO Ildaeil Plugin
+ * Copyright (C) 2021-2025 Filipe Coelho <falktx@falktx.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include "VST3ModuleInfo.hpp"
+
+#include <cstdio>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static int sFailures = 0;
+
+#define CHECK(cond)                                                 \
+    if (! (cond)) {                                                 \
+        std::fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        ++sFailures;                                                \
+    }
+
+// synthetic bundle with the quirks found in the wild: comments, trailing commas, unquoted keys,
+// a non-audio class, a class without vendor and sub-categories in both array and string form
+static const char* const kModuleInfo = "\xEF\xBB\xBF"
+"// generated by moduleinfotool\n"
+"{\n"
+"  Name: 'Test Bundle',\n"
+"  \"Version\": \"1.0.0\",\n"
+"  \"Factory Info\": {\n"
+"    \"Vendor\": \"Factory Vendor\",\n"
+"    \"Flags\": { \"Unicode\": true, },\n"
+"  },\n"
+"  \"Classes\": [\n"
+"    {\n"
+"      \"CID\": \"0123456789ABCDEF0123456789abcdef\",\n"
+"      \"Category\": \"Audio Module Class\",\n"
+"      \"Name\": \"Test \\\"Reverb\\\" \\u00e9\",\n"
+"      \"Vendor\": \"Class Vendor\",\n"
+"      \"Sub Categories\": [ \"Fx\", \"Reverb\", ],\n"
+"      \"Cardinality\": 2147483647,\n"
+"      \"Snapshots\": [],\n"
+"    },\n"
+"    /* controller classes are not plugins */\n"
+"    {\n"
+"      \"CID\": \"FEDCBA9876543210FEDCBA9876543210\",\n"
+"      \"Category\": \"Component Controller Class\",\n"
+"      \"Name\": \"Test Controller\",\n"
+"    },\n"
+"    {\n"
+"      \"CID\": \"00000000111111112222222233333333\",\n"
+"      \"Category\": \"Audio Module Class\",\n"
+"      \"Name\": \"Test Synth\",\n"
+"      \"Sub Categories\": \"Instrument|Synth\",\n"
+"      \"Version\": -0x10,\n"
+"    },\n"
+"  ],\n"
+"}\n";
+
+static void testValidBundle()
+{
+    std::vector<VST3ModuleInfoClass> classes;
+    CHECK(parseVST3ModuleInfo(kModuleInfo, classes));
+    CHECK(classes.size() == 2);
+
+    if (classes.size() != 2)
+        return;
+
+    CHECK(classes[0].cid == "0x01234567,0x89ABCDEF,0x01234567,0x89ABCDEF");
+    CHECK(classes[0].name == "Test \"Reverb\" \xC3\xA9");
+    CHECK(classes[0].vendor == "Class Vendor");
+    CHECK(classes[0].subCategories.size() == 2);
+    CHECK(classes[0].subCategories.size() == 2 && classes[0].subCategories[1] == "Reverb");
+
+    CHECK(classes[1].cid == "0x00000000,0x11111111,0x22222222,0x33333333");
+    CHECK(classes[1].name == "Test Synth");
+    CHECK(classes[1].vendor == "Factory Vendor");
+    CHECK(classes[1].subCategories.size() == 2);
+    CHECK(classes[1].subCategories.size() == 2 && classes[1].subCategories[0] == "Instrument");
+}
+
+static void testInvalidBundles()
+{
+    std::vector<VST3ModuleInfoClass> classes;
+
+    // malformed
+    CHECK(! parseVST3ModuleInfo("", classes));
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [ ", classes));
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [] } trailing", classes));
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": \"none\" }", classes));
+
+    // class id of the wrong size or with non-hex characters
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [ { \"CID\": \"0123\", \"Name\": \"A\","
+                                "\"Category\": \"Audio Module Class\" } ] }", classes));
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [ { \"CID\": \"0123456789ABCDEF0123456789ABCDEG\", \"Name\": \"A\","
+                                "\"Category\": \"Audio Module Class\" } ] }", classes));
+
+    // audio class without a name
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [ { \"CID\": \"0123456789ABCDEF0123456789ABCDEF\","
+                                "\"Category\": \"Audio Module Class\" } ] }", classes));
+
+    // no audio classes at all
+    CHECK(! parseVST3ModuleInfo("{ \"Classes\": [ { \"CID\": \"0123456789ABCDEF0123456789ABCDEF\", \"Name\": \"A\","
+                                "\"Category\": \"Component Controller Class\" } ] }", classes));
+
+    // nesting deep enough to be an attack rather than a real file
+    std::string deep("{ \"Classes\": [], \"Deep\": ");
+    deep.append(100, '[');
+    deep.append(100, ']');
+    deep += " }";
+    CHECK(! parseVST3ModuleInfo(deep.c_str(), classes));
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
+
+int main()
+{
+    USE_NAMESPACE_DISTRHO;
+
+    testValidBundle();
+    testInvalidBundles();
+
+    if (sFailures != 0)
+    {
+        std::fprintf(stderr, "%i checks failed\n", sFailures);
+        return 1;
+    }
+
+    std::printf("All VST3ModuleInfo checks passed\n");
+    return 0;
+}